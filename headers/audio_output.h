@@ -0,0 +1,39 @@
+#pragma once
+#include "beeper.h"
+#include <SDL2/SDL_audio.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Plays the samples queued in a ring through an SDL audio device. The
+// device's callback only pops from the ring; when it comes up short the
+// rest of the buffer is silence and an underrun is counted. Any SDL driver
+// works, including "dummy" and "disk" (SDL_AUDIODRIVER) for headless runs.
+class AudioOutput {
+public:
+  AudioOutput() = default;
+  ~AudioOutput();
+  AudioOutput(AudioOutput const &) = delete;
+  AudioOutput &operator=(AudioOutput const &) = delete;
+
+  // Opens the device with a buffer of about `bufferMilliseconds`, which
+  // bounds the latency. Fails, saying why in `error`, if there is no audio.
+  bool Open(unsigned int bufferMilliseconds, std::string &error);
+  void Close();
+  // Valid once opened
+  unsigned int SampleRate() const { return sampleRate; }
+  AudioRing &Ring() { return *ring; }
+  uint64_t Underruns() const { return underruns.load(); }
+
+private:
+  static void Callback(void *self, Uint8 *stream, int length);
+
+  SDL_AudioDeviceID device{};
+  unsigned int sampleRate{};
+  std::unique_ptr<AudioRing> ring;
+  std::atomic<uint64_t> underruns{};
+  // Set by the callback once samples arrive, so waiting for the first
+  // frame does not count as an underrun
+  bool playing{};
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include "chip8.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Steps many independent Chip8 sessions at once across a thread pool.
+// Keys, framebuffers and status are kept as arrays indexed by instance so
+// a host can exchange them in bulk after every step.
+class Batch {
+public:
+  // Instance i is seeded with seed + i, so a batch run again with the
+  // same seed, ROM and keys repeats exactly
+  Batch(size_t count, ThreadPool &pool, uint32_t seed,
+        Variant variant = Variant::CosmacVip);
+  size_t Size() const { return instances.size(); }
+  Chip8 &Instance(size_t i) { return *instances[i]; }
+
+  // Loads the ROM into every instance, false if Chip8::LoadROM would fail
+  bool LoadROM(uint8_t const *data, size_t size);
+  void SetKeys(size_t i, uint16_t keys) { this->keys[i] = keys; }
+  void StepCycles(uint32_t cycles);
+  void StepFrame(uint32_t instructionsPerFrame);
+
+  // One Display per instance, updated when it changes
+  uint64_t const *Framebuffers() const { return framebuffers.data(); }
+  // Non-zero where the instance is in high resolution mode
+  uint8_t const *HiRes() const { return hires.data(); }
+  // Non-zero where the display changed during the last step
+  uint8_t const *DisplayChanged() const { return displayChanged.data(); }
+  // Why each instance's last step returned, what a stop left unrun and the
+  // first fault since it was loaded
+  StopReason const *StopReasons() const { return stopReasons.data(); }
+  uint32_t const *CyclesLeft() const { return cyclesLeft.data(); }
+  Fault const *Faults() const { return faults.data(); }
+
+private:
+  template <typename StepFunc> void Step(StepFunc const &step);
+
+  ThreadPool &pool;
+  std::vector<std::unique_ptr<Chip8>> instances;
+  std::vector<uint16_t> keys;
+  std::vector<uint64_t> framebuffers;
+  std::vector<uint8_t> hires;
+  std::vector<uint8_t> displayChanged;
+  std::vector<StopReason> stopReasons;
+  std::vector<uint32_t> cyclesLeft;
+  std::vector<Fault> faults;
+};
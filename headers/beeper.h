@@ -0,0 +1,32 @@
+#pragma once
+#include "chip8.h"
+#include "spsc_ring.h"
+#include <cstdint>
+
+typedef SpscRing<int16_t> AudioRing;
+
+// Turns the sound timer into mono 16-bit samples, one 60 Hz frame at a
+// time: the audio pattern is played while the timer runs, at the rate
+// XO-CHIP's pitch sets. Samples go into a ring drained by the audio
+// device; generating them never allocates or blocks.
+class Beeper {
+public:
+  Beeper(AudioRing &ring, unsigned int sampleRate);
+  // Queues one frame of sound, or silence unless `audible`. Samples the
+  // ring has no room for are dropped and counted.
+  void Frame(Chip8 const &chip8, bool audible = true);
+  uint64_t Dropped() const { return dropped; }
+
+private:
+  static const unsigned int CHUNK = 256;
+
+  AudioRing &ring;
+  unsigned int sampleRate;
+  // Leftover of sampleRate / 60, so frames average out to the exact rate
+  unsigned int remainder{};
+  // Position in the pattern in 1/2^32 bits, kept across frames so the
+  // waveform has no seams
+  uint64_t phase{};
+  uint64_t dropped{};
+  int16_t chunk[CHUNK];
+};
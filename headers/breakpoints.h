@@ -0,0 +1,62 @@
+#pragma once
+#include "chip8.h"
+#include <cstdint>
+
+// Where a Chip8 attached with SetBreakpoints() stops: at code addresses, at
+// opcodes matching a pattern and at instructions about to read or write
+// watched memory. Each kind is a bitmap, so checking an instruction costs a
+// few bit tests however many are set. Stops happen before the instruction
+// runs. Resuming runs it, stopping again only for a watchpoint it touches
+// after a breakpoint stopped at it.
+class Breakpoints {
+public:
+  enum class Access { Read = 1, Write = 2, ReadWrite = 3 };
+
+  // The last stop, Budget for none since attaching
+  struct Hit {
+    StopReason reason;
+    uint16_t pc;
+    uint16_t opcode;
+    // The first watched byte the instruction touches, for watchpoints
+    uint16_t address;
+    Access access;
+  };
+
+  Breakpoints();
+
+  // Addresses wrap at CODE_MEMORY, like the program counter
+  void SetBreakpoint(uint16_t address, bool set = true);
+  // Every opcode with (opcode & mask) == pattern, so 0xD000/0xF000 breaks
+  // on every draw
+  void SetOpcodeBreakpoint(uint16_t pattern, uint16_t mask, bool set = true);
+  // `length` bytes from `first`, wrapping at MEMORY
+  void SetWatchpoint(uint16_t first, uint32_t length, Access access,
+                     bool set = true);
+  void Clear();
+  bool Empty() const;
+
+  bool Breaks(uint16_t address) const {
+    address &= CODE_MEMORY - 1u;
+    return (code[address / 64u] >> (address % 64u)) & 1u;
+  }
+  bool BreaksOn(uint16_t opcode) const {
+    return (opcodes[opcode / 64u] >> (opcode % 64u)) & 1u;
+  }
+  // Whether any of `length` bytes from `first` is watched for `access`,
+  // Read or Write, and which came first
+  bool Watched(uint16_t first, uint32_t length, Access access,
+               uint16_t &address) const;
+
+  Hit const &LastHit() const { return hit; }
+
+private:
+  friend class Chip8;
+
+  static const unsigned int OPCODES = 0x10000;
+
+  uint64_t code[CODE_MEMORY / 64];
+  uint64_t opcodes[OPCODES / 64];
+  uint64_t reads[MEMORY / 64];
+  uint64_t writes[MEMORY / 64];
+  Hit hit;
+};
@@ -1,66 +1,335 @@
 #pragma once
+#include "quirks.h"
+#include <cstddef>
 #include <cstdint>
-#include <random>
+#include <memory>
+#include <string>
 
 const unsigned int KEY_COUNT = 16;
-const unsigned int DISPLAY_Width = 64;
-const unsigned int DISPLAY_Height = 32;
-const unsigned int MEMORY = 4096;
+// The SUPER-CHIP high resolution mode; the original 64x32 is the low one
+const unsigned int DISPLAY_Width = 128;
+const unsigned int DISPLAY_Height = 64;
+const unsigned int LORES_Width = 64;
+const unsigned int LORES_Height = 32;
+const unsigned int DISPLAY_Words = DISPLAY_Width / 64;
+const unsigned int PLANES = 2;
+const unsigned int MEMORY = 0x10000;
+// Jumps and calls only reach 12 bits, so code runs from the first 4 KB and
+// the program counter wraps there
+const unsigned int CODE_MEMORY = 0x1000;
+// Programs are loaded from here to the end of memory
+const unsigned int START_ADDRESS = 0x200;
+const unsigned int MAX_ROM_SIZE = MEMORY - START_ADDRESS;
 const unsigned int STACK = 16;
 const unsigned int REGISTERS = 16;
+// Bytes in the XO-CHIP audio pattern, played one bit per sample step
+const unsigned int AUDIO_PATTERN = 16;
+// Plays the pattern at 4000 bits per second
+const uint8_t DEFAULT_PITCH = 64;
+
+class Breakpoints;
+class Profiler;
+class Recompiler;
+class TraceWriter;
+
+// Bit planes of packed rows, the leftmost pixel of each row in the top bit
+// of its first word. In low resolution only the first word of the first
+// LORES_Height rows is used.
+typedef uint64_t Display[PLANES][DISPLAY_Height][DISPLAY_Words];
+
+// Expands display rows to a DISPLAY_Width x DISPLAY_Height RGBA8888 image,
+// doubling pixels in low resolution. Rows count in the display's resolution.
+void ExpandVideo(Display const &display, bool hires, uint32_t *rgba,
+                 unsigned int firstRow = 0,
+                 unsigned int rowCount = DISPLAY_Height);
+
+enum class Engine { Interpreter, Recompiler };
+
+// How the interpreter finds the handler for an instruction. The default is
+// set at build time by CHIP8_DISPATCH; results never depend on it.
+enum class Dispatch {
+  // Per-address cache of decoded instructions holding their handlers
+  Cached,
+  // Fetch every instruction and switch on its opcode
+  Switch,
+  // Threaded code jumping between labels (computed goto), or Switch where
+  // the compiler lacks it
+  Threaded,
+  // Fetch every instruction and call through a 64K table indexed by opcode
+  Table,
+};
+
+char const *DispatchName(Dispatch dispatch);
+// Accepts the names DispatchName() returns
+bool ParseDispatch(char const *name, Dispatch &dispatch);
+
+// What a program spinning in an idle loop is waiting for. Such loops only
+// read state they leave unchanged, so they can be fast-forwarded exactly.
+enum class Wait {
+  None,
+  // A loop polling the delay timer with Fx07, until the next tick
+  DelayTimer,
+  // Fx0A, or a loop polling keys with Ex9E/ExA1, until the keys change
+  Keypad,
+  // A loop that depends on nothing that can change, such as 00FD
+  Forever,
+};
+
+// Something a program did that would crash the original interpreter. The
+// instruction is skipped and the first fault since the last LoadState()
+// or ClearFault() is kept.
+enum class Fault {
+  None,
+  // An opcode that is no instruction in the current variant
+  InvalidOpcode,
+  // 2nnn with all STACK entries in use
+  StackOverflow,
+  // 00EE with nothing to return to
+  StackUnderflow,
+};
+
+char const *FaultName(Fault fault);
+
+// Why RunCycles() or RunFrame() returned
+enum class StopReason {
+  // The whole budget ran
+  Budget,
+  // An instruction drew, cleared or scrolled the display, with
+  // SetStopOnDraw() on
+  Draw,
+  // The whole budget ran and the program is waiting for a key, in Fx0A or
+  // a loop polling the keypad
+  KeyWait,
+  // An instruction faulted, with SetStopOnFault() on; see Faulted()
+  Fault,
+  // The next instruction is at a breakpoint or has an opcode one names
+  Breakpoint,
+  // The next instruction reads or writes watched memory
+  Watchpoint,
+};
+
+char const *StopReasonName(StopReason reason);
+
+// Complete machine state, as captured by Chip8::SaveState(). Padding is
+// explicit and always zero so states can be compared and hashed bytewise.
+struct Chip8State {
+  uint8_t memory[MEMORY];
+  Display display;
+  uint16_t stack[STACK];
+  uint8_t registers[REGISTERS];
+  uint8_t flags[REGISTERS];
+  uint8_t audioPattern[AUDIO_PATTERN];
+  uint32_t rngState;
+  uint16_t index;
+  uint16_t pc;
+  uint8_t sp;
+  uint8_t delayTimer;
+  uint8_t soundTimer;
+  uint8_t hires;
+  uint8_t planes;
+  uint8_t pitch;
+  uint8_t padding[2];
+};
+static_assert(sizeof(Chip8State) % 8 == 0 &&
+                  offsetof(Chip8State, padding) + 2 == sizeof(Chip8State),
+              "Chip8State must not have implicit padding");
 
 class Chip8 {
 public:
+  // Seeds the random number generator from the clock
   Chip8();
+  explicit Chip8(uint32_t seed, Variant variant = Variant::CosmacVip);
+  ~Chip8();
   void Cycle();
-  void LoadROM(char const *filename);
+  // Runs up to `count` instructions, or fewer when a stop turned on below
+  // ends it early; CyclesLeft() then says how many were not run
+  StopReason RunCycles(uint32_t count);
+  // Runs a frame's instructions, then ticks the timers. A frame that a stop
+  // cuts short is finished by the next call, which ticks them instead.
+  StopReason RunFrame(uint32_t instructionsPerFrame);
+  void TickTimers();
+  void SetKeypad(uint16_t keys);
+  void Seed(uint32_t seed);
+  // Stops RunCycles() after every instruction that changes the display
+  void SetStopOnDraw(bool stop) { stopOnDraw = stop; }
+  // Stops RunCycles() after an instruction raises the kept fault
+  void SetStopOnFault(bool stop);
+  // Cycles of the last RunCycles() budget left unrun by a stop
+  uint32_t CyclesLeft() const { return stopLeft; }
+  void SetEngine(Engine engine);
+  void SetDispatch(Dispatch dispatch) { this->dispatch = dispatch; }
+  Dispatch GetDispatch() const { return dispatch; }
+  // Switches instruction semantics to those of `variant`
+  void SetVariant(Variant variant);
+  Variant GetVariant() const { return variant; }
+  // Both fail, leaving memory untouched, for an empty ROM or one larger
+  // than MAX_ROM_SIZE; the file version also says why in `error`
+  bool LoadROM(char const *filename, std::string &error);
+  bool LoadROM(uint8_t const *data, size_t size);
+  bool HiRes() const { return hires; }
+  bool DisplayDirty() const { return dirtyFirst < dirtyEnd; }
+  unsigned int DirtyFirstRow() const { return dirtyFirst; }
+  unsigned int DirtyRowCount() const { return dirtyEnd - dirtyFirst; }
+  void ClearDirty();
+  void SaveState(Chip8State &state) const;
+  void LoadState(Chip8State const &state);
+  // XXH64 of the saved state, for comparing runs
+  uint64_t StateHash() const;
+  // XXH64 of the registers, I, pc, the stack and the timers only: cheap
+  // enough to compare runs every few instructions
+  uint64_t CpuHash() const;
+  // What the program was waiting for when the last RunCycles() ended
+  Wait Waiting() const { return waiting; }
+  Fault Faulted() const { return fault; }
+  // Where the faulting instruction was
+  uint16_t FaultAddress() const { return faultAddress; }
+  void ClearFault() { fault = Fault::None; }
+  // Cycles skipped over idle loops, which are still counted as run
+  uint64_t IdleCycles() const { return idleCycles; }
+  // Idle loops are skipped unless turned off here, as benchmarks do so
+  // that every cycle counted is an instruction run
+  void SetSkipIdle(bool skip) { skipIdle = skip; }
+  // Whether the sound timer was running at the last TickTimers(), and what
+  // the beeper plays meanwhile: the audio pattern at a rate set by the pitch
+  bool Buzzing() const { return buzzing; }
+  uint8_t const *AudioPattern() const { return audioPattern; }
+  uint8_t Pitch() const { return pitch; }
+  // Records every instruction RunCycles() and RunFrame() run into `tracer`,
+  // or stops when null. While tracing, the interpreter is used regardless
+  // of the engine and idle loops are run rather than skipped.
+  void SetTracer(TraceWriter *tracer) { this->tracer = tracer; }
+  // Stops RunCycles() before instructions `breakpoints` names, or stops
+  // checking when null. While attached a checked instantiation of the
+  // interpreter runs regardless of the engine, and idle loops are run
+  // rather than skipped; detached, nothing is checked at all.
+  void SetBreakpoints(Breakpoints *breakpoints) {
+    this->breakpoints = breakpoints;
+  }
+#ifdef CHIP8_PROFILE
+  // Profiles the instructions run by RunCycles() and RunFrame() into
+  // `profiler`, or stops when null. While profiling, the interpreter is used
+  // regardless of the engine.
+  void SetProfiler(Profiler *profiler);
+#endif
   uint8_t keypad[KEY_COUNT]{};
-  uint32_t video[DISPLAY_Width * DISPLAY_Height]{};
+  Display display{};
 
 private:
-  std::default_random_engine randGen;
-  std::uniform_int_distribution<uint8_t> randByte;
-
-  void Table0();
-  void Table8();
-  void TableE();
-  void TableF();
-  void OP_NULL();
-  void OP_00E0();
-  void OP_00EE();
-  void OP_1nnn();
-  void OP_3xkk();
-  void OP_2nnn();
-  void OP_4xkk();
-  void OP_5xy0();
-  void OP_6xkk();
-  void OP_7xkk();
-  void OP_8xy0();
-  void OP_8xy1();
-  void OP_8xy2();
-  void OP_8xy3();
-  void OP_8xy4();
-  void OP_8xy5();
-  void OP_8xy6();
-  void OP_8xy7();
-  void OP_8xyE();
-  void OP_9xy0();
-  void OP_Annn();
-  void OP_Bnnn();
-  void OP_Cxkk();
-  void OP_Dxyn();
-  void OP_Ex9E();
-  void OP_ExA1();
-  void OP_Fx07();
-  void OP_Fx0A();
-  void OP_Fx15();
-  void OP_Fx18();
-  void OP_Fx1E();
-  void OP_Fx29();
-  void OP_Fx55();
-  void OP_Fx65();
-  void OP_Fx33();
+  friend class Recompiler;
+
+  uint8_t RandomByte();
+
+  // A decoded instruction, cached per address so the hot path skips
+  // fetching, table lookups and operand extraction
+  struct Instruction;
+  typedef void (*Handler)(Chip8 &, Instruction const &);
+  struct Instruction {
+    Handler handler;
+    uint16_t opcode;
+    uint16_t nnn;
+    uint8_t x;
+    uint8_t y;
+    uint8_t kk;
+    uint8_t n;
+  };
+  typedef void (Chip8::*Chip8Func)(Instruction const &);
+
+  template <Chip8Func F>
+  static void Invoke(Chip8 &chip8, Instruction const &op) {
+    (chip8.*F)(op);
+  }
+
+  template <typename Quirks> void UseQuirks();
+  void Fetch(Instruction &op, uint16_t address) const;
+  void Decode(uint16_t address);
+  template <typename Quirks> void RunDispatched();
+  template <typename Quirks> void RunSwitch();
+  template <typename Quirks> void RunThreaded();
+  template <typename Quirks> void RunTable();
+  template <typename Quirks> void Execute(Instruction const &op);
+  template <typename Quirks> void ExecuteGroup(Instruction const &op);
+  template <typename Quirks> static constexpr Handler HandlerFor(uint16_t op);
+  void InvalidateCode(uint16_t address, size_t length);
+  uint32_t IdleLoopLength(Wait &wait);
+  uint32_t FastForward(uint32_t cycles);
+  uint32_t RunTraced(uint32_t count);
+  template <typename Quirks> uint32_t RunChecked(uint32_t count);
+  template <typename Quirks>
+  bool Breaks(Instruction const &op, StopReason resumed);
+  template <bool LongSkip> void Skip();
+  void Raise(Fault fault) {
+    if (this->fault == Fault::None) {
+      this->fault = fault;
+      faultAddress = pc - 2;
+      if (stopOnFault) {
+        Stop(StopReason::Fault);
+      }
+    }
+  }
+  // Ends the current RunCycles() after this instruction
+  void Stop(StopReason reason) {
+    if (stopReason == StopReason::Budget) {
+      stopReason = reason;
+      stopLeft = cyclesLeft;
+      cyclesLeft = 0;
+    }
+  }
+  StopReason Stopped() const;
+  void MarkDirty(unsigned int first, unsigned int end);
+  void OP_NULL(Instruction const &op);
+  void OP_00Cn(Instruction const &op);
+  void OP_00Dn(Instruction const &op);
+  void OP_00E0(Instruction const &op);
+  void OP_00EE(Instruction const &op);
+  void OP_00FB(Instruction const &op);
+  void OP_00FC(Instruction const &op);
+  void OP_00FD(Instruction const &op);
+  void OP_00FE(Instruction const &op);
+  void OP_00FF(Instruction const &op);
+  void OP_1nnn(Instruction const &op);
+  template <bool LongSkip> void OP_3xkk(Instruction const &op);
+  void OP_2nnn(Instruction const &op);
+  template <bool LongSkip> void OP_4xkk(Instruction const &op);
+  template <bool LongSkip> void OP_5xy0(Instruction const &op);
+  void OP_5xy2(Instruction const &op);
+  void OP_5xy3(Instruction const &op);
+  void OP_6xkk(Instruction const &op);
+  void OP_7xkk(Instruction const &op);
+  void OP_8xy0(Instruction const &op);
+  template <bool ResetVF> void OP_8xy1(Instruction const &op);
+  template <bool ResetVF> void OP_8xy2(Instruction const &op);
+  template <bool ResetVF> void OP_8xy3(Instruction const &op);
+  void OP_8xy4(Instruction const &op);
+  void OP_8xy5(Instruction const &op);
+  template <bool ShiftVy> void OP_8xy6(Instruction const &op);
+  void OP_8xy7(Instruction const &op);
+  template <bool ShiftVy> void OP_8xyE(Instruction const &op);
+  template <bool LongSkip> void OP_9xy0(Instruction const &op);
+  void OP_Annn(Instruction const &op);
+  template <bool JumpVx> void OP_Bnnn(Instruction const &op);
+  void OP_Cxkk(Instruction const &op);
+  template <bool Wrap, bool BigSprites> void OP_Dxyn(Instruction const &op);
+  template <bool LongSkip> void OP_Ex9E(Instruction const &op);
+  template <bool LongSkip> void OP_ExA1(Instruction const &op);
+  void OP_F000(Instruction const &op);
+  void OP_F002(Instruction const &op);
+  void OP_Fn01(Instruction const &op);
+  void OP_Fx07(Instruction const &op);
+  void OP_Fx0A(Instruction const &op);
+  void OP_Fx15(Instruction const &op);
+  void OP_Fx18(Instruction const &op);
+  void OP_Fx1E(Instruction const &op);
+  void OP_Fx29(Instruction const &op);
+  void OP_Fx30(Instruction const &op);
+  void OP_Fx3A(Instruction const &op);
+  template <IndexStep Step> void OP_Fx55(Instruction const &op);
+  template <IndexStep Step> void OP_Fx65(Instruction const &op);
+  void OP_Fx33(Instruction const &op);
+  void OP_Fx75(Instruction const &op);
+  void OP_Fx85(Instruction const &op);
   uint8_t registers[REGISTERS]{};
+  // SUPER-CHIP's flag registers, saved by Fx75 and restored by Fx85
+  uint8_t flags[REGISTERS]{};
   uint8_t memory[MEMORY]{};
   uint16_t index{};
   uint16_t pc{};
@@ -68,11 +337,59 @@ private:
   uint8_t sp{};
   uint8_t delayTimer{};
   uint8_t soundTimer{};
-  uint16_t opcode{};
-  typedef void (Chip8::*Chip8Func)();
-  Chip8Func table[0xF + 1];
-  Chip8Func table0[0xE + 1];
-  Chip8Func table8[0xE + 1];
-  Chip8Func tableE[0xE + 1];
-  Chip8Func tableF[0x65 + 1];
+  // XO-CHIP's audio pattern and pitch, loaded by F002 and Fx3A
+  uint8_t audioPattern[AUDIO_PATTERN]{};
+  uint8_t pitch{DEFAULT_PITCH};
+  bool buzzing{};
+  uint32_t rngState{};
+  bool hires{};
+  // Bit mask of the planes drawing, clearing and scrolling act on
+  uint8_t planes{1};
+  Handler table[0xF + 1];
+  Handler table0[0xFF + 1];
+  Handler table5[0xF + 1];
+  Handler table8[0xF + 1];
+  Handler tableE[0xF + 1];
+  Handler tableF[0xFF + 1];
+  Instruction decoded[CODE_MEMORY]{};
+  // Display rows changed since the last ClearDirty()
+  uint8_t dirtyFirst{};
+  uint8_t dirtyEnd{DISPLAY_Height};
+  // Bumped whenever a write lands on decoded code, or anything else the
+  // recompiler's blocks depend on changes
+  uint32_t codeGeneration{};
+  // Cycles left in the current interpreter RunCycles(), which handlers
+  // ending in an idle loop cut short
+  uint32_t cyclesLeft{};
+  Wait waiting{Wait::None};
+  // Why the current RunCycles() stopped, Budget while it has not
+  StopReason stopReason{StopReason::Budget};
+  uint32_t stopLeft{};
+  bool stopOnDraw{};
+  bool stopOnFault{};
+  // Cycles of a frame cut short by a stop, for the next RunFrame()
+  uint32_t frameLeft{};
+  Fault fault{Fault::None};
+  uint16_t faultAddress{};
+  uint64_t idleCycles{};
+  bool skipIdle{true};
+  Engine engine{Engine::Interpreter};
+  Dispatch dispatch{Dispatch::Cached};
+  Variant variant{Variant::CosmacVip};
+  std::unique_ptr<Recompiler> recompiler;
+  TraceWriter *tracer{};
+  Breakpoints *breakpoints{};
+  // What stopped the machine before the next instruction, which is not
+  // checked for again, Budget when nothing did
+  StopReason resumed{StopReason::Budget};
+#ifdef CHIP8_PROFILE
+  // Control flow handlers report transfers to the profiler while attached
+  template <Chip8Func F>
+  static void ProfiledInvoke(Chip8 &chip8, Instruction const &op);
+  static Handler Profiled(Handler handler);
+  void SampledExecute(Instruction const &op);
+  Profiler *profiler{};
+  // Instructions left until the end of the current sample window
+  unsigned int sampling{};
+#endif
 };
@@ -0,0 +1,150 @@
+#pragma once
+// C interface to the emulator core, exported by the chip8 shared library.
+// Functions are only ever added, and enum values never renumbered, so a
+// program built against one CHIP8_API_VERSION runs against any later
+// library; check chip8_api_version() at startup to require a minimum.
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(CHIP8_BUILDING_LIBRARY)
+#define CHIP8_API __declspec(dllexport)
+#else
+#define CHIP8_API __declspec(dllimport)
+#endif
+#else
+#define CHIP8_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHIP8_API_VERSION 2
+
+#define CHIP8_DISPLAY_WIDTH 128
+#define CHIP8_DISPLAY_HEIGHT 64
+#define CHIP8_KEY_COUNT 16
+
+typedef struct chip8 chip8;
+
+enum chip8_variant {
+  CHIP8_VARIANT_COSMAC_VIP = 0,
+  CHIP8_VARIANT_CHIP48 = 1,
+  CHIP8_VARIANT_SUPER_CHIP = 2,
+  CHIP8_VARIANT_XO_CHIP = 3
+};
+
+enum chip8_engine {
+  CHIP8_ENGINE_INTERPRETER = 0,
+  CHIP8_ENGINE_RECOMPILER = 1
+};
+
+// Why chip8_run_cycles() or chip8_run_frame() returned
+enum chip8_stop {
+  // The whole budget ran
+  CHIP8_STOP_BUDGET = 0,
+  // An instruction changed the display, with chip8_set_stop_on_draw()
+  CHIP8_STOP_DRAW = 1,
+  // The whole budget ran and the program is waiting for a key
+  CHIP8_STOP_KEY_WAIT = 2,
+  // An instruction faulted, with chip8_set_stop_on_fault()
+  CHIP8_STOP_FAULT = 3,
+  // Since version 2: the next instruction is at a breakpoint
+  CHIP8_STOP_BREAKPOINT = 4,
+  // Since version 2: the next instruction touches watched memory
+  CHIP8_STOP_WATCHPOINT = 5
+};
+
+enum chip8_access {
+  CHIP8_ACCESS_READ = 1,
+  CHIP8_ACCESS_WRITE = 2,
+  CHIP8_ACCESS_READ_WRITE = 3
+};
+
+enum chip8_fault {
+  CHIP8_FAULT_NONE = 0,
+  CHIP8_FAULT_INVALID_OPCODE = 1,
+  CHIP8_FAULT_STACK_OVERFLOW = 2,
+  CHIP8_FAULT_STACK_UNDERFLOW = 3
+};
+
+// CHIP8_API_VERSION of the library
+CHIP8_API uint32_t chip8_api_version(void);
+
+// NULL for an unknown variant or when out of memory
+CHIP8_API chip8 *chip8_create(uint32_t seed, int variant);
+CHIP8_API void chip8_destroy(chip8 *machine);
+
+// 1 on success; 0, leaving memory untouched, for an empty ROM or one too
+// large to fit
+CHIP8_API int chip8_load_rom(chip8 *machine, uint8_t const *data,
+                             size_t size);
+// 0 for an unknown engine. The recompiler falls back to the interpreter
+// where it is not supported.
+CHIP8_API int chip8_set_engine(chip8 *machine, int engine);
+// Bit n set while key n is held
+CHIP8_API void chip8_set_keypad(chip8 *machine, uint16_t keys);
+CHIP8_API void chip8_set_stop_on_draw(chip8 *machine, int stop);
+CHIP8_API void chip8_set_stop_on_fault(chip8 *machine, int stop);
+
+// Runs up to `count` instructions and returns a chip8_stop. When `left` is
+// not NULL it receives the instructions a stop left unrun.
+CHIP8_API int chip8_run_cycles(chip8 *machine, uint32_t count,
+                               uint32_t *left);
+// Runs a frame's instructions and ticks the timers, returning a
+// chip8_stop. A frame a stop cuts short is finished by the next call;
+// `left` receives what it has yet to run, 0 once the frame is done.
+CHIP8_API int chip8_run_frame(chip8 *machine, uint32_t instructions,
+                              uint32_t *left);
+CHIP8_API void chip8_tick_timers(chip8 *machine);
+
+// The first fault since loading a state or clearing it, as a chip8_fault,
+// and where the faulting instruction was when `address` is not NULL
+CHIP8_API int chip8_fault(chip8 const *machine, uint16_t *address);
+CHIP8_API void chip8_clear_fault(chip8 *machine);
+
+CHIP8_API int chip8_hires(chip8 const *machine);
+CHIP8_API int chip8_buzzing(chip8 const *machine);
+// Display rows changed since the last chip8_clear_dirty(), counted in the
+// display's resolution; returns the number of rows
+CHIP8_API unsigned int chip8_dirty_rows(chip8 const *machine,
+                                        unsigned int *first);
+CHIP8_API void chip8_clear_dirty(chip8 *machine);
+// Writes CHIP8_DISPLAY_WIDTH x CHIP8_DISPLAY_HEIGHT RGBA8888 pixels,
+// doubled in low resolution
+CHIP8_API void chip8_video(chip8 const *machine, uint32_t *rgba);
+
+// Since version 2. Breakpoints stop a run before the instruction; the next
+// run starts by running it unchecked. Checking only slows the machine down
+// while any breakpoint or watchpoint is set.
+CHIP8_API void chip8_set_breakpoint(chip8 *machine, uint16_t address,
+                                    int set);
+// Every opcode with (opcode & mask) == pattern
+CHIP8_API void chip8_set_opcode_breakpoint(chip8 *machine, uint16_t pattern,
+                                           uint16_t mask, int set);
+// `length` bytes from `first`, for a chip8_access
+CHIP8_API void chip8_set_watchpoint(chip8 *machine, uint16_t first,
+                                    uint32_t length, int access, int set);
+CHIP8_API void chip8_clear_breakpoints(chip8 *machine);
+// The last breakpoint or watchpoint stop as a chip8_stop, CHIP8_STOP_BUDGET
+// for none: where the instruction was and, for watchpoints, the first
+// watched address it touches and how, as a chip8_access
+CHIP8_API int chip8_last_break(chip8 const *machine, uint16_t *pc,
+                               uint16_t *address, int *access);
+
+// Saved states are plain bytes, valid for the library that made them
+CHIP8_API size_t chip8_state_size(void);
+// Both return 0 when `size` is not chip8_state_size() or memory runs out
+CHIP8_API int chip8_save_state(chip8 const *machine, void *state,
+                               size_t size);
+CHIP8_API int chip8_load_state(chip8 *machine, void const *state,
+                               size_t size);
+CHIP8_API uint64_t chip8_state_hash(chip8 const *machine);
+
+CHIP8_API char const *chip8_stop_name(int stop);
+CHIP8_API char const *chip8_fault_name(int fault);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,8 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// The instruction `opcode` in the usual CHIP-8 assembly syntax, including
+// the SUPER-CHIP and XO-CHIP extensions, told apart the way Chip8 decodes
+// them. Words that are no instruction come out as "DW 0xNNNN".
+std::string Disassemble(uint16_t opcode);
@@ -0,0 +1,65 @@
+#pragma once
+#include "beeper.h"
+#include "chip8.h"
+#include "input_log.h"
+#include "rewind.h"
+#include "triple_buffer.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+struct Frame {
+  Display display;
+  bool hires;
+};
+
+// Runs a Chip8 at 60 frames per second on its own thread. Completed frames
+// are published through a triple buffer and keys arrive as an atomic
+// bitmask, so the host thread and the emulator never wait on each other.
+class EmulationThread {
+public:
+  EmulationThread(Chip8 &chip8, uint32_t instructionsPerFrame);
+  ~EmulationThread();
+  void Start();
+  void Stop();
+  void SetKeys(uint16_t keys) { this->keys.store(keys); }
+  // While set, frames step backwards through the rewind history
+  void SetRewinding(bool rewinding) { this->rewinding.store(rewinding); }
+  // Records the keys of every frame into `log`; set before Start()
+  void SetRecording(InputLog *log) { recording = log; }
+  // Queues each frame's sound through `beeper`; set before Start()
+  void SetAudio(Beeper *beeper) { this->beeper = beeper; }
+  // Shows the frame `frames` ahead of the emulated one, run with the keys
+  // held now and then discarded, which hides that many frames of a game's
+  // own input lag; set before Start()
+  void SetRunAhead(unsigned int frames) { runAhead = frames; }
+  // While set, frames run unthrottled and one is published per 60 Hz
+  // display interval; sound and rewind keep working at the real rate
+  void SetTurbo(bool turbo) { this->turbo.store(turbo); }
+  // Frames emulated so far, forward or back, for measuring the speed
+  uint64_t FramesRun() const { return framesRun.load(); }
+  TripleBuffer<Frame> &Frames() { return frames; }
+
+private:
+  void Run();
+  void Step(bool audible);
+  void RunAhead(uint16_t held);
+
+  Chip8 &chip8;
+  uint32_t instructionsPerFrame;
+  std::atomic<uint16_t> keys{};
+  std::atomic<bool> running{};
+  std::atomic<bool> rewinding{};
+  std::atomic<bool> turbo{};
+  std::atomic<uint64_t> framesRun{};
+  RewindBuffer history;
+  Chip8State snapshot{};
+  InputLog *recording{};
+  Beeper *beeper{};
+  unsigned int runAhead{};
+  // The real machine state while frames are run ahead of it
+  Chip8State present{};
+  uint32_t frame{};
+  TripleBuffer<Frame> frames;
+  std::thread thread;
+};
@@ -0,0 +1,127 @@
+#pragma once
+#include "chip8.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Set of 64-bit hashes that any number of threads insert into without
+// locks: open addressing with linear probing, each slot claimed by a
+// compare-and-swap. Zero marks an empty slot, so it is stored as one.
+class TranspositionTable {
+public:
+  // Holds at least `capacity` hashes, rounded up to a power of two
+  explicit TranspositionTable(size_t capacity);
+  void Clear();
+  bool Contains(uint64_t hash) const;
+  // True if the hash was not there before; false too once the table is full
+  bool Insert(uint64_t hash);
+
+private:
+  std::unique_ptr<std::atomic<uint64_t>[]> slots;
+  size_t size;
+};
+
+// XOR of the hashes of every STATE_BLOCK bytes of a state, so the hash of
+// a state reached from another follows by rehashing only the blocks that
+// differ, which after a frame is usually a few
+uint64_t BlockHash(Chip8State const &state);
+uint64_t UpdateBlockHash(uint64_t hash, Chip8State const &from,
+                         Chip8State const &to);
+
+// Explores the states a program can reach by branching on its input at
+// frame boundaries: from each state, holding each of the KEY_COUNT keys or
+// none for a step of some frames. States are expanded a batch at a time
+// across a thread pool, then deduplicated by BlockHash() in a
+// transposition table in the order the batch lists them, so the result
+// does not depend on the number of threads. They are kept XOR-RLE encoded
+// against the root in one arena.
+class Explorer {
+public:
+  enum class Order {
+    // All states one step from the root, then two, and so on
+    BreadthFirst,
+    // States that showed a screen not seen before first, then breadth
+    // first; reaches new screens sooner in deep games
+    BestFirst,
+  };
+
+  struct Settings {
+    Variant variant{Variant::CosmacVip};
+    Engine engine{Engine::Interpreter};
+    uint32_t instructionsPerFrame{15};
+    // Frames each input is held for
+    uint32_t framesPerStep{4};
+    // Stops once this many distinct states have been found
+    size_t maxStates{100000};
+    // Steps from the root beyond which states are not expanded
+    uint32_t maxDepth{UINT32_MAX};
+    Order order{Order::BreadthFirst};
+  };
+
+  // A state reached, and how: the input held for the step from `parent`,
+  // KEY_COUNT for none
+  struct Node {
+    uint32_t parent;
+    uint32_t depth;
+    uint8_t key;
+    Fault fault;
+    uint16_t faultAddress;
+    size_t offset;
+    size_t size;
+    uint64_t hash;
+  };
+
+  Explorer(ThreadPool &pool, Settings const &settings);
+  ~Explorer();
+
+  // Explores from `root` until every reachable state is found or a limit is
+  // hit. Faulted states are kept but not explored further.
+  void Run(Chip8State const &root);
+
+  std::vector<Node> const &Nodes() const { return nodes; }
+  // Indices of the nodes where the program faulted, in the order found
+  std::vector<uint32_t> const &Faults() const { return faults; }
+  // Distinct displays among the states found
+  size_t Screens() const { return screenCount; }
+  // States reached again, by another path or after an idle step
+  uint64_t Duplicates() const { return duplicates; }
+
+  // The keys held on the way from the root to `node`, KEY_COUNT for none
+  std::vector<uint8_t> Inputs(uint32_t node) const;
+  void State(uint32_t node, Chip8State &state) const;
+
+private:
+  struct Child;
+  struct Scratch;
+
+  struct Entry {
+    bool newScreen;
+    uint32_t node;
+  };
+
+  void Expand(std::vector<uint32_t> const &batch, std::vector<Child> &children,
+              size_t begin, size_t end);
+  void Add(Node node, std::vector<uint8_t> const &encoded, bool newScreen);
+  bool Later(Entry const &a, Entry const &b) const;
+
+  ThreadPool &pool;
+  Settings settings;
+  TranspositionTable states;
+  TranspositionTable screens;
+  std::unique_ptr<Chip8State> root;
+
+  std::vector<Node> nodes;
+  std::vector<uint8_t> arena;
+  std::vector<uint32_t> faults;
+  size_t screenCount{};
+  uint64_t duplicates{};
+  // Nodes still to expand, a heap ordered by Settings::order
+  std::vector<Entry> frontier;
+
+  std::mutex spareMutex;
+  std::vector<std::unique_ptr<Scratch>> spare;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// XXH64, used to fingerprint machine states and ROMs. Output matches the
+// reference implementation on little-endian hosts.
+const uint64_t XXH_PRIME1 = 0x9E3779B185EBCA87ull;
+const uint64_t XXH_PRIME2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t XXH_PRIME3 = 0x165667B19E3779F9ull;
+const uint64_t XXH_PRIME4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t XXH_PRIME5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t XXHRotl(uint64_t value, unsigned int bits) {
+  return (value << bits) | (value >> (64u - bits));
+}
+
+inline uint64_t XXHRead64(uint8_t const *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint32_t XXHRead32(uint8_t const *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint64_t XXHRound(uint64_t acc, uint64_t input) {
+  return XXHRotl(acc + input * XXH_PRIME2, 31) * XXH_PRIME1;
+}
+
+inline uint64_t XXHMerge(uint64_t acc, uint64_t value) {
+  return (acc ^ XXHRound(0, value)) * XXH_PRIME1 + XXH_PRIME4;
+}
+
+inline uint64_t Hash64(void const *data, size_t size, uint64_t seed = 0) {
+  uint8_t const *p = static_cast<uint8_t const *>(data);
+  uint8_t const *end = p + size;
+  uint64_t hash;
+
+  if (size >= 32) {
+    uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+    uint64_t v2 = seed + XXH_PRIME2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - XXH_PRIME1;
+
+    for (; p + 32 <= end; p += 32) {
+      v1 = XXHRound(v1, XXHRead64(p));
+      v2 = XXHRound(v2, XXHRead64(p + 8));
+      v3 = XXHRound(v3, XXHRead64(p + 16));
+      v4 = XXHRound(v4, XXHRead64(p + 24));
+    }
+
+    hash = XXHRotl(v1, 1) + XXHRotl(v2, 7) + XXHRotl(v3, 12) + XXHRotl(v4, 18);
+    hash = XXHMerge(hash, v1);
+    hash = XXHMerge(hash, v2);
+    hash = XXHMerge(hash, v3);
+    hash = XXHMerge(hash, v4);
+  } else {
+    hash = seed + XXH_PRIME5;
+  }
+
+  hash += size;
+
+  for (; p + 8 <= end; p += 8) {
+    hash ^= XXHRound(0, XXHRead64(p));
+    hash = XXHRotl(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+  }
+  if (p + 4 <= end) {
+    hash ^= uint64_t(XXHRead32(p)) * XXH_PRIME1;
+    hash = XXHRotl(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    hash ^= *p * XXH_PRIME5;
+    hash = XXHRotl(hash, 11) * XXH_PRIME1;
+  }
+
+  hash ^= hash >> 33u;
+  hash *= XXH_PRIME2;
+  hash ^= hash >> 29u;
+  hash *= XXH_PRIME3;
+  hash ^= hash >> 32u;
+  return hash;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "quirks.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The keypad changed to `keys` at the start of `frame`
+struct InputEvent {
+  uint32_t frame;
+  uint16_t keys;
+};
+
+// A recorded session: everything needed to re-run it deterministically.
+// Only keypad changes are stored, so an idle minute costs nothing and a
+// busy one a few hundred bytes.
+class InputLog {
+public:
+  InputLog() = default;
+  InputLog(uint32_t seed, Variant variant, uint32_t instructionsPerFrame,
+           uint64_t initialHash);
+
+  // Notes the keys held for `frame`; frames must be recorded in order
+  void Record(uint32_t frame, uint16_t keys);
+  // Drops everything from `frame` on, after rewinding to it
+  void Truncate(uint32_t frame);
+  // Keys held during `frame`. Lookups are expected in increasing frame
+  // order and are amortised O(1); going backwards restarts the scan.
+  uint16_t KeysAt(uint32_t frame);
+
+  bool Save(char const *filename) const;
+  bool Load(char const *filename);
+
+  uint32_t Seed() const { return seed; }
+  Variant GetVariant() const { return variant; }
+  uint32_t InstructionsPerFrame() const { return instructionsPerFrame; }
+  // Hash of the machine state after the ROM was loaded
+  uint64_t InitialHash() const { return initialHash; }
+  uint32_t FrameCount() const { return frameCount; }
+  std::vector<InputEvent> const &Events() const { return events; }
+
+private:
+  uint32_t seed{};
+  Variant variant{Variant::CosmacVip};
+  uint32_t instructionsPerFrame{};
+  uint64_t initialHash{};
+  uint32_t frameCount{};
+  std::vector<InputEvent> events;
+  size_t cursor{};
+};
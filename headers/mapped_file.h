@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A read-only view of a whole file. It is memory-mapped where the platform
+// allows, so opening costs the same whatever the size and only the pages
+// touched are read; elsewhere the file is read into a buffer.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(MappedFile const &) = delete;
+  MappedFile &operator=(MappedFile const &) = delete;
+
+  // On failure `error` says why and the view is left empty
+  bool Open(char const *filename, std::string &error);
+  void Close();
+
+  uint8_t const *Data() const { return data; }
+  size_t Size() const { return size; }
+
+private:
+  uint8_t const *data{};
+  size_t size{};
+  bool mapped{};
+  std::vector<uint8_t> buffer;
+};
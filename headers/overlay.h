@@ -0,0 +1,26 @@
+#pragma once
+#include <SDL2/SDL.h>
+
+class Profiler;
+struct ImDrawData;
+
+// Dear ImGui window showing a Profiler, drawn over the emulator output
+// with the SDL renderer. F1 toggles it.
+class Overlay {
+public:
+  Overlay(SDL_Window *window, SDL_Renderer *renderer);
+  ~Overlay();
+  Overlay(Overlay const &) = delete;
+  Overlay &operator=(Overlay const &) = delete;
+
+  void ProcessEvent(SDL_Event const &event);
+  bool Visible() const { return visible; }
+  void Draw(Profiler const &profiler);
+
+private:
+  void Render(ImDrawData const *data);
+
+  SDL_Renderer *renderer;
+  SDL_Texture *fontTexture{};
+  bool visible{true};
+};
@@ -2,22 +2,44 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_video.h>
 #include <cstdint>
+#include <memory>
 #include <stdint.h>
 
 class SDL_Window;
 class SDL_Renderer;
 class SDL_Texture;
+class Overlay;
+class Profiler;
 
 class Platform {
 public:
   Platform(char const *title, int windowWidth, int windowHeight,
            int textureWidth, int textureHeight);
   ~Platform();
-  void Update(void const *buffer, int pitch);
+  void Update(void const *buffer, int pitch, int firstRow, int rowCount);
+  void Present();
   bool ProcessInput(uint8_t *keys);
+  bool RewindHeld() const { return rewindHeld; }
+  // Toggled by Tab
+  bool Turbo() const { return turbo; }
+  void SetTurbo(bool turbo) { this->turbo = turbo; }
+  void SetTitle(char const *title);
+#ifdef CHIP8_PROFILE
+  // Draws `profiler` in an overlay, toggled with F1
+  void ShowProfiler(Profiler const *profiler);
+#endif
 
 private:
   SDL_Window *window{};
   SDL_Renderer *renderer{};
   SDL_Texture *texture{};
+  int textureWidth{};
+  // Set when the texture changed or the window needs repainting
+  bool presentPending{true};
+  bool rewindHeld{};
+  bool turbo{};
+#ifdef CHIP8_PROFILE
+  std::unique_ptr<Overlay> overlay;
+  Profiler const *profiler{};
+#endif
 };
@@ -0,0 +1,132 @@
+#pragma once
+#include "chip8.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Execution profile of one Chip8, filled in by its interpreter in builds
+// with CHIP8_PROFILE.
+//
+// Straight-line execution is not recorded at all: only control transfers
+// bump a counter, at the address left and at the address entered. How
+// often any address ran then follows exactly from a running sum over
+// memory, so only jumps, calls, skips and key waits pay for profiling.
+// Execution running off the end of memory is not tracked. Timing is
+// sampled: every SAMPLE_PERIOD-th transfer, SAMPLE_WINDOW instructions
+// somewhere in the following block are timed individually.
+//
+// Opcode totals and loops are derived from the opcode decoded at each
+// address. When self-modifying code replaces one, the counts gathered so
+// far are first folded into per-opcode totals, so those stay exact too.
+//
+// Counters are relaxed atomics so another thread can read them while the
+// emulator runs. Only the emulating thread writes them, so a plain load and
+// store is enough.
+class Profiler {
+public:
+  static const unsigned int SAMPLE_PERIOD = 1024;
+  static const unsigned int SAMPLE_WINDOW = 4;
+  static const unsigned int SAMPLE_SKIP = 64;
+
+  struct OpcodeStats {
+    char const *mnemonic;
+    uint64_t count;
+    // Estimated from the sampled instructions, in timestamp counter ticks
+    uint64_t ticks;
+  };
+
+  // A backward 1nnn jump from end to start
+  struct Loop {
+    uint16_t start;
+    uint16_t end;
+    uint64_t iterations;
+    // Instructions executed between start and end, inclusive
+    uint64_t instructions;
+  };
+
+  Profiler();
+  Profiler(Profiler const &) = delete;
+  Profiler &operator=(Profiler const &) = delete;
+
+  // Chip8::RunCycles() starts and stops executing at `address`. Counts are
+  // exact in between calls; during one, the addresses after the current PC
+  // may read one too high.
+  void Enter(uint16_t address) { Add(entries[Mask(address)], 1); }
+  void Leave(uint16_t address) { Add(entries[Mask(address)], -1); }
+
+  // Called by Chip8 when it decodes the instruction it is about to run
+  void Decoded(uint16_t address, uint16_t opcode);
+
+  // Control went from `from` to `to` instead of to from + 2. Returns how
+  // many of the following instructions make up a sample window, or 0.
+  unsigned int Transfer(uint16_t from, uint16_t to) {
+    Add(exits[Mask(from)], 1);
+    Add(entries[Mask(to)], 1);
+
+    if (--untilSample != 0) {
+      return 0;
+    }
+    // Start the window at a varying distance into the block, so timing
+    // is not biased towards the instructions right after a jump
+    untilSample = SAMPLE_PERIOD;
+    skip = (skip + 37u) % SAMPLE_SKIP;
+    return skip + SAMPLE_WINDOW;
+  }
+
+  void AddSample(uint16_t address, uint64_t ticks) {
+    ticks = ticks > overhead ? ticks - overhead : 0;
+    Add(this->ticks[Mask(address)], ticks);
+    Add(samples[Mask(address)], 1);
+  }
+
+  static uint64_t Ticks();
+  static char const *Mnemonic(uint16_t opcode);
+
+  // Per-mnemonic totals, most expensive first
+  std::vector<OpcodeStats> Opcodes() const;
+  std::vector<Loop> HotLoops(size_t count) const;
+  // Executions of every address, for the heatmap
+  std::vector<uint64_t> Hits() const;
+  uint64_t Instructions() const;
+
+private:
+  static constexpr std::memory_order relaxed = std::memory_order_relaxed;
+
+  struct Retired {
+    uint64_t count;
+    uint64_t ticks;
+  };
+
+  static unsigned int Mask(uint16_t address) {
+    return address & (CODE_MEMORY - 1u);
+  }
+
+  static void Add(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(relaxed) + value, relaxed);
+  }
+
+  // Executions of `address` since the profiler was attached
+  uint64_t CountAt(unsigned int address) const;
+  // Executions of the opcode currently at `address`, and their cost
+  uint64_t SinceDecoded(unsigned int address, uint64_t count) const;
+  uint64_t EstimatedTicks(unsigned int address, uint64_t count) const;
+
+  // Wrapping counters; entries minus exits may go negative in between
+  std::atomic<uint64_t> entries[CODE_MEMORY]{};
+  std::atomic<uint64_t> exits[CODE_MEMORY]{};
+  std::atomic<uint64_t> ticks[CODE_MEMORY]{};
+  std::atomic<uint64_t> samples[CODE_MEMORY]{};
+  std::atomic<uint16_t> opcodes[CODE_MEMORY]{};
+  // CountAt() when the current opcode was decoded
+  std::atomic<uint64_t> decodedAt[CODE_MEMORY]{};
+  // Folded in from opcodes that have since been overwritten
+  std::map<uint16_t, Retired> retired;
+  mutable std::mutex retiredMutex;
+  unsigned int untilSample{SAMPLE_PERIOD};
+  unsigned int skip{};
+  // Cost of reading the timestamp counter itself
+  uint64_t overhead{};
+};
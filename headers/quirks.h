@@ -0,0 +1,63 @@
+#pragma once
+
+// CHIP-8 dialects whose instruction semantics differ
+enum class Variant { CosmacVip, Chip48, SuperChip, XoChip };
+
+// Where Fx55 and Fx65 leave I
+enum class IndexStep { Unchanged, X, XPlusOne };
+
+// Quirk policies, one per Variant. Every handler whose behaviour differs
+// between dialects is a template over the quirk it depends on, and Chip8
+// fills its dispatch tables with the instantiations a policy names, so no
+// handler tests a quirk at run time.
+struct CosmacVipQuirks {
+  // 8xy1, 8xy2 and 8xy3 clear VF
+  static const bool logicResetsVF = true;
+  // 8xy6 and 8xyE shift Vy into Vx instead of shifting Vx in place
+  static const bool shiftUsesVy = true;
+  static const IndexStep loadStoreStep = IndexStep::XPlusOne;
+  // Bnnn jumps to nnn + Vx, x being the top nibble of nnn, not nnn + V0
+  static const bool jumpUsesVx = false;
+  // Dxyn wraps sprites around the screen edges instead of clipping them
+  static const bool spritesWrap = false;
+  // SUPER-CHIP instructions: 128x64 mode, scrolling, 16x16 sprites, the
+  // large font and the flag registers
+  static const bool superChipOps = false;
+  // XO-CHIP instructions: bit planes, F000 nnnn, 5xy2/5xy3 and 00Dn. Skips
+  // step over the whole of a four-byte F000 nnnn.
+  static const bool xoChipOps = false;
+};
+
+struct Chip48Quirks {
+  static const bool logicResetsVF = false;
+  static const bool shiftUsesVy = false;
+  static const IndexStep loadStoreStep = IndexStep::X;
+  static const bool jumpUsesVx = true;
+  static const bool spritesWrap = false;
+  static const bool superChipOps = false;
+  static const bool xoChipOps = false;
+};
+
+struct SuperChipQuirks {
+  static const bool logicResetsVF = false;
+  static const bool shiftUsesVy = false;
+  static const IndexStep loadStoreStep = IndexStep::Unchanged;
+  static const bool jumpUsesVx = true;
+  static const bool spritesWrap = false;
+  static const bool superChipOps = true;
+  static const bool xoChipOps = false;
+};
+
+struct XoChipQuirks {
+  static const bool logicResetsVF = false;
+  static const bool shiftUsesVy = true;
+  static const IndexStep loadStoreStep = IndexStep::XPlusOne;
+  static const bool jumpUsesVx = false;
+  static const bool spritesWrap = true;
+  static const bool superChipOps = true;
+  static const bool xoChipOps = true;
+};
+
+char const *VariantName(Variant variant);
+// Accepts the names VariantName() returns
+bool ParseVariant(char const *name, Variant &variant);
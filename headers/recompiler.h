@@ -0,0 +1,44 @@
+#pragma once
+#include "chip8.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Translates CHIP-8 basic blocks into x86-64 code. Blocks end at jumps,
+// skips, calls, draws, memory stores and, while they stop the machine,
+// invalid opcodes, and are cached by start address until a store lands on
+// decoded code. Instructions without a native
+// translation call their OP_* handler from the generated code.
+class Recompiler {
+public:
+  explicit Recompiler(Chip8 &chip8);
+  ~Recompiler();
+  Recompiler(Recompiler const &) = delete;
+  Recompiler &operator=(Recompiler const &) = delete;
+
+  static bool Supported();
+  // Returns the cycles left unrun when the machine stops early
+  uint32_t Run(uint32_t cycles);
+
+private:
+  typedef void (*Code)(Chip8 *);
+
+  struct Block {
+    Code code;
+    uint32_t length;
+  };
+
+  Block &Compile(uint16_t address);
+  void Flush();
+
+  Chip8 &chip8;
+  // Where blocks are emitted, and the executable view of the same memory
+  // they run from
+  uint8_t *buffer{};
+  uint8_t *runnable{};
+  size_t used{};
+  uint32_t generation{};
+  Block blocks[CODE_MEMORY]{};
+  // Copies of the decoded instructions passed to fallback handlers
+  std::vector<Chip8::Instruction> constants;
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include "chip8.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Ring buffer of past machine states for rewinding. Each snapshot is stored
+// as the XOR against the one before it with runs of zero bytes elided, and
+// every keyframeInterval-th snapshot is stored whole, compressed the same
+// way. Once the byte budget is reached the oldest keyframe group is dropped.
+class RewindBuffer {
+public:
+  explicit RewindBuffer(size_t capacityBytes = 16u << 20u,
+                        unsigned int keyframeInterval = 60);
+
+  void Push(Chip8State const &state);
+  // Removes the newest snapshot and returns it, false once empty
+  bool Pop(Chip8State &state);
+  void Clear();
+
+  size_t Count() const { return entries.size(); }
+  size_t BytesUsed() const { return bytesUsed; }
+
+  // XOR-RLE codec, also used for other state deltas. Encode writes at most
+  // MaxEncodedSize(size) bytes; Decode XORs the delta into target.
+  static size_t MaxEncodedSize(size_t size) { return size * 2 + 16; }
+  static size_t Encode(uint8_t const *a, uint8_t const *b, size_t size,
+                       uint8_t *out);
+  static void Decode(uint8_t const *in, size_t size, uint8_t *target);
+
+private:
+  struct Entry {
+    size_t offset;
+    size_t size;
+    bool keyframe;
+  };
+
+  void EvictOldest();
+
+  std::vector<uint8_t> arena;
+  std::deque<Entry> entries;
+  size_t head{};
+  size_t bytesUsed{};
+  unsigned int keyframeInterval;
+  unsigned int sinceKeyframe{};
+  // The newest snapshot, which the next delta is taken against
+  Chip8State last{};
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include "chip8.h"
+#include "mapped_file.h"
+#include "quirks.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What a ROM needs to run as its author intended
+struct RomSettings {
+  Variant variant{Variant::CosmacVip};
+  // 0 leaves the choice to the front-end
+  uint16_t instructionsPerFrame{};
+  // CHIP-8 key i is driven by keypad key keymap[i]
+  uint8_t keymap[KEY_COUNT]{0, 1, 2,  3,  4,  5,  6,  7,
+                            8, 9, 10, 11, 12, 13, 14, 15};
+};
+
+struct RomEntry {
+  uint64_t hash;
+  RomSettings settings;
+};
+
+// Fingerprint of a ROM image, the key of the database
+uint64_t RomHash(uint8_t const *data, size_t size);
+
+// Guesses the dialect from the instructions a ROM uses, for ROMs missing
+// from the database. Only 2-byte aligned words are considered, and the
+// original CHIP-8 is assumed unless SUPER-CHIP or XO-CHIP instructions show.
+Variant DetectVariant(uint8_t const *data, size_t size);
+
+// Per-ROM settings keyed by RomHash(). On disk a small header is followed
+// by fixed-size records sorted by hash; the file is mapped and binary
+// searched, so nothing is parsed up front and a lookup costs the same in
+// a library of ten ROMs or ten thousand.
+class RomDatabase {
+public:
+  // A missing file is an error; an empty database is a valid file
+  bool Open(char const *filename, std::string &error);
+  bool Find(uint64_t hash, RomSettings &settings) const;
+  size_t Count() const { return count; }
+  // Every entry, in hash order, for editing and saving back
+  std::vector<RomEntry> Entries() const;
+
+  static bool Save(char const *filename, std::vector<RomEntry> entries,
+                   std::string &error);
+
+private:
+  MappedFile file;
+  uint8_t const *records{};
+  size_t count{};
+};
@@ -0,0 +1,22 @@
+#pragma once
+#include <chrono>
+
+// Paces emulation at a fixed frame rate. A host that falls behind catches
+// up by running several frames at once, up to a limit beyond which the
+// backlog is dropped, and the thread sleeps until the next frame is due.
+class FrameScheduler {
+public:
+  explicit FrameScheduler(double framesPerSecond = 60.0,
+                          unsigned int maxCatchUp = 4);
+  unsigned int FramesDue();
+  // Whether the next frame is due, without counting it
+  bool FrameDue() const { return Clock::now() >= next; }
+  void WaitForNextFrame() const;
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  Clock::duration period;
+  Clock::time_point next;
+  unsigned int maxCatchUp;
+};
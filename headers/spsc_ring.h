@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+// Lock-free queue from one producer thread to one consumer thread. The
+// capacity is fixed when it is created, so neither side allocates, and
+// each side only writes its own position.
+template <typename T> class SpscRing {
+public:
+  // Holds at least `capacity` items, rounded up to a power of two
+  explicit SpscRing(size_t capacity) {
+    size = 1;
+    while (size < capacity) {
+      size <<= 1u;
+    }
+    items = std::make_unique<T[]>(size);
+  }
+
+  size_t Capacity() const { return size; }
+
+  // Items waiting to be read; a lower bound on the producer side and an
+  // upper bound on the consumer side
+  size_t Available() const {
+    return head.load(std::memory_order_acquire) -
+           tail.load(std::memory_order_acquire);
+  }
+
+  // Producer side, returns how many of `count` items fitted
+  size_t Push(T const *source, size_t count) {
+    size_t const write = head.load(std::memory_order_relaxed);
+    size_t const space = size - (write - tail.load(std::memory_order_acquire));
+    count = count < space ? count : space;
+
+    // In at most two pieces, where the ring wraps
+    size_t const start = write & (size - 1u);
+    size_t const first = count < size - start ? count : size - start;
+    std::memcpy(&items[start], source, first * sizeof(T));
+    std::memcpy(&items[0], source + first, (count - first) * sizeof(T));
+
+    head.store(write + count, std::memory_order_release);
+    return count;
+  }
+
+  // Consumer side, returns how many items were read into `target`
+  size_t Pop(T *target, size_t count) {
+    size_t const read = tail.load(std::memory_order_relaxed);
+    size_t const ready = head.load(std::memory_order_acquire) - read;
+    count = count < ready ? count : ready;
+
+    size_t const start = read & (size - 1u);
+    size_t const first = count < size - start ? count : size - start;
+    std::memcpy(target, &items[start], first * sizeof(T));
+    std::memcpy(target + first, &items[0], (count - first) * sizeof(T));
+
+    tail.store(read + count, std::memory_order_release);
+    return count;
+  }
+
+private:
+  std::unique_ptr<T[]> items;
+  size_t size;
+  // Free-running counts of items written and read; they only wrap together
+  alignas(64) std::atomic<size_t> head{};
+  alignas(64) std::atomic<size_t> tail{};
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for data-parallel loops. ParallelFor() gives
+// every worker a contiguous share of the index range; workers claim chunks
+// of their own share first and then steal chunks from the others, so
+// uneven work still finishes together. The calling thread joins in.
+class ThreadPool {
+public:
+  // 0 threads means one per hardware thread
+  explicit ThreadPool(unsigned int threads = 0);
+  ~ThreadPool();
+  ThreadPool(ThreadPool const &) = delete;
+  ThreadPool &operator=(ThreadPool const &) = delete;
+
+  unsigned int Size() const { return size; }
+  void ParallelFor(size_t count,
+                   std::function<void(size_t begin, size_t end)> const &body);
+
+private:
+  struct alignas(64) Share {
+    std::atomic<size_t> next{};
+    size_t end{};
+  };
+
+  void Worker(unsigned int id);
+  void Work(unsigned int id);
+
+  unsigned int size;
+  std::unique_ptr<Share[]> shares;
+  std::vector<std::thread> threads;
+  std::function<void(size_t, size_t)> const *body{};
+  size_t chunk{};
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  uint64_t generation{};
+  unsigned int busy{};
+  bool stopping{};
+};
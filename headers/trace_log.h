@@ -0,0 +1,99 @@
+#pragma once
+#include "chip8.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One executed instruction: where it ran, what it was, and I, Vx and VF
+// after it ran, which covers every register an instruction writes but for
+// Fx65 and Fx85
+struct TraceRecord {
+  uint16_t pc;
+  uint16_t opcode;
+  uint16_t index;
+  uint8_t vx;
+  uint8_t vf;
+};
+static_assert(sizeof(TraceRecord) == 8, "TraceRecord must be 8 bytes");
+
+// Writes the instructions a Chip8 runs to a file. The emulation thread
+// fills a small batch and hands full batches to a background thread
+// through a lock-free ring; that thread compresses them into chunks and
+// writes them out. If the writer falls behind, the emulator waits rather
+// than drop records.
+class TraceWriter {
+public:
+  TraceWriter();
+  ~TraceWriter();
+  TraceWriter(TraceWriter const &) = delete;
+  TraceWriter &operator=(TraceWriter const &) = delete;
+
+  bool Open(char const *filename, Variant variant, std::string &error);
+  // Writes out everything recorded, false if any write failed
+  bool Close();
+
+  // Emulation thread side
+  void Record(TraceRecord const &record) {
+    batch[used++] = record;
+    if (used == BATCH) {
+      Submit();
+    }
+  }
+  // Hands the records batched so far to the writer thread
+  void Submit();
+  uint64_t Records() const { return records; }
+
+private:
+  static const size_t BATCH = 1024;
+
+  void Drain();
+  bool WriteChunk(size_t count);
+
+  SpscRing<TraceRecord> ring;
+  std::FILE *file{};
+  std::thread thread;
+  std::atomic<bool> open{};
+  TraceRecord batch[BATCH];
+  size_t used{};
+  uint64_t records{};
+
+  // Writer thread side. Each record is stored as the bytes that differ
+  // from the record that followed the previous one's pc last time, which
+  // in a loop is usually all but a register.
+  std::vector<TraceRecord> chunk;
+  std::vector<uint8_t> encoded;
+  TraceRecord successors[CODE_MEMORY]{};
+  uint16_t previousPc{};
+  bool failed{};
+};
+
+class TraceReader {
+public:
+  TraceReader() = default;
+  ~TraceReader();
+  TraceReader(TraceReader const &) = delete;
+  TraceReader &operator=(TraceReader const &) = delete;
+
+  bool Open(char const *filename, std::string &error);
+  // The next record, false at the end; Failed() tells a truncated or
+  // corrupt trace from a complete one
+  bool Next(TraceRecord &record);
+  bool Failed() const { return failed; }
+  Variant GetVariant() const { return variant; }
+
+private:
+  bool ReadChunk();
+
+  std::FILE *file{};
+  Variant variant{Variant::CosmacVip};
+  std::vector<TraceRecord> chunk;
+  std::vector<uint8_t> encoded;
+  size_t position{};
+  TraceRecord successors[CODE_MEMORY]{};
+  uint16_t previousPc{};
+  bool failed{};
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free handoff of the latest value from one producer thread to one
+// consumer thread. Neither side ever waits; the consumer always sees the
+// most recently published value and skips any it missed.
+template <typename T> class TripleBuffer {
+public:
+  // Producer side
+  T &WriteBuffer() { return buffers[writeIndex]; }
+
+  void Publish() {
+    uint8_t previous = middle.exchange(writeIndex | FRESH,
+                                       std::memory_order_acq_rel);
+    writeIndex = previous & INDEX;
+  }
+
+  // Consumer side, returns false if nothing new was published
+  bool Update() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+      return false;
+    }
+
+    uint8_t previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+    readIndex = previous & INDEX;
+    return true;
+  }
+
+  T const &ReadBuffer() const { return buffers[readIndex]; }
+
+private:
+  static const uint8_t INDEX = 0x3;
+  static const uint8_t FRESH = 0x4;
+
+  T buffers[3]{};
+  std::atomic<uint8_t> middle{1};
+  uint8_t writeIndex{0};
+  uint8_t readIndex{2};
+};
@@ -0,0 +1,78 @@
+#include "../headers/audio_output.h"
+#include <SDL2/SDL.h>
+#include <cstring>
+
+namespace {
+
+const int SAMPLE_RATE = 48000;
+const unsigned int FRAMES_PER_SECOND = 60;
+
+} // namespace
+
+AudioOutput::~AudioOutput() { Close(); }
+
+bool AudioOutput::Open(unsigned int bufferMilliseconds, std::string &error) {
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+    error = std::string("No audio: ") + SDL_GetError();
+    return false;
+  }
+
+  // SDL wants a power of two number of samples per callback
+  Uint16 samples = 1;
+  while (samples < SAMPLE_RATE * bufferMilliseconds / 1000 &&
+         samples < 0x8000) {
+    samples <<= 1u;
+  }
+
+  SDL_AudioSpec wanted{};
+  wanted.freq = SAMPLE_RATE;
+  wanted.format = AUDIO_S16SYS;
+  wanted.channels = 1;
+  wanted.samples = samples;
+  wanted.callback = &AudioOutput::Callback;
+  wanted.userdata = this;
+
+  SDL_AudioSpec obtained{};
+  device = SDL_OpenAudioDevice(nullptr, 0, &wanted, &obtained,
+                               SDL_AUDIO_ALLOW_FREQUENCY_CHANGE |
+                                   SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+  if (device == 0) {
+    error = std::string("No audio: ") + SDL_GetError();
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    return false;
+  }
+
+  // Room for one device buffer plus the frame being generated; a fuller
+  // ring would only add latency, so the beeper drops what does not fit
+  sampleRate = obtained.freq;
+  ring = std::make_unique<AudioRing>(obtained.samples +
+                                     sampleRate / FRAMES_PER_SECOND + 1);
+
+  SDL_PauseAudioDevice(device, 0);
+  return true;
+}
+
+void AudioOutput::Close() {
+  if (device == 0) {
+    return;
+  }
+
+  SDL_CloseAudioDevice(device);
+  SDL_QuitSubSystem(SDL_INIT_AUDIO);
+  device = 0;
+}
+
+void AudioOutput::Callback(void *self, Uint8 *stream, int length) {
+  AudioOutput &output = *static_cast<AudioOutput *>(self);
+  int16_t *samples = reinterpret_cast<int16_t *>(stream);
+  size_t count = length / sizeof(int16_t);
+
+  size_t read = output.ring->Pop(samples, count);
+  if (read < count) {
+    memset(samples + read, 0, (count - read) * sizeof(int16_t));
+    if (output.playing) {
+      output.underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  output.playing |= read > 0;
+}
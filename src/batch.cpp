@@ -0,0 +1,63 @@
+#include "../headers/batch.h"
+#include <cstring>
+
+namespace {
+
+const size_t DISPLAY_Size = sizeof(Display) / sizeof(uint64_t);
+
+} // namespace
+
+Batch::Batch(size_t count, ThreadPool &pool, uint32_t seed, Variant variant)
+    : pool(pool), keys(count), framebuffers(count * DISPLAY_Size),
+      hires(count), displayChanged(count), stopReasons(count),
+      cyclesLeft(count), faults(count) {
+  instances.reserve(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    instances.push_back(std::make_unique<Chip8>(seed + i, variant));
+  }
+}
+
+bool Batch::LoadROM(uint8_t const *data, size_t size) {
+  if (size == 0 || size > MAX_ROM_SIZE) {
+    return false;
+  }
+
+  pool.ParallelFor(Size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      instances[i]->LoadROM(data, size);
+    }
+  });
+  return true;
+}
+
+template <typename StepFunc> void Batch::Step(StepFunc const &step) {
+  pool.ParallelFor(Size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      Chip8 &chip8 = *instances[i];
+
+      chip8.SetKeypad(keys[i]);
+      stopReasons[i] = step(chip8);
+      cyclesLeft[i] = chip8.CyclesLeft();
+      faults[i] = chip8.Faulted();
+
+      displayChanged[i] = chip8.DisplayDirty();
+      if (displayChanged[i]) {
+        memcpy(&framebuffers[i * DISPLAY_Size], chip8.display,
+               sizeof(chip8.display));
+        hires[i] = chip8.HiRes();
+        chip8.ClearDirty();
+      }
+    }
+  });
+}
+
+void Batch::StepCycles(uint32_t cycles) {
+  Step([cycles](Chip8 &chip8) { return chip8.RunCycles(cycles); });
+}
+
+void Batch::StepFrame(uint32_t instructionsPerFrame) {
+  Step([instructionsPerFrame](Chip8 &chip8) {
+    return chip8.RunFrame(instructionsPerFrame);
+  });
+}
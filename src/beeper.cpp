@@ -0,0 +1,44 @@
+#include "../headers/beeper.h"
+#include <cmath>
+
+namespace {
+
+const unsigned int FRAMES_PER_SECOND = 60;
+const int16_t AMPLITUDE = 6000;
+const unsigned int PATTERN_BITS = AUDIO_PATTERN * 8;
+
+} // namespace
+
+Beeper::Beeper(AudioRing &ring, unsigned int sampleRate)
+    : ring(ring), sampleRate(sampleRate) {}
+
+void Beeper::Frame(Chip8 const &chip8, bool audible) {
+  remainder += sampleRate;
+  unsigned int samples = remainder / FRAMES_PER_SECOND;
+  remainder %= FRAMES_PER_SECOND;
+
+  bool on = audible && chip8.Buzzing();
+  uint8_t const *pattern = chip8.AudioPattern();
+  // XO-CHIP plays 4000 * 2^((pitch - 64) / 48) pattern bits per second
+  double rate = 4000.0 * std::exp2((chip8.Pitch() - 64.0) / 48.0);
+  uint64_t step = uint64_t(rate / sampleRate * 4294967296.0);
+
+  while (samples > 0) {
+    unsigned int count = samples < CHUNK ? samples : CHUNK;
+
+    for (unsigned int i = 0; i < count; ++i) {
+      unsigned int bit = (phase >> 32u) % PATTERN_BITS;
+      bool high = (pattern[bit / 8] >> (7 - bit % 8)) & 1u;
+      chunk[i] = !on ? 0 : high ? AMPLITUDE : -AMPLITUDE;
+      phase += step;
+    }
+
+    dropped += count - ring.Push(chunk, count);
+    samples -= count;
+  }
+
+  if (!on) {
+    // Start the next tone at the beginning of the pattern
+    phase = 0;
+  }
+}
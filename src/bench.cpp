@@ -0,0 +1,296 @@
+#include "../headers/batch.h"
+#include "../headers/chip8.h"
+#ifdef CHIP8_PROFILE
+#include "../headers/profiler.h"
+#endif
+#include "../headers/thread_pool.h"
+#include "../headers/trace_log.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint64_t DEFAULT_CYCLES = 50000000;
+const uint64_t KERNEL_CYCLES = 10000000;
+const unsigned int KERNEL_REPEAT = 16;
+const uint64_t BATCH_CYCLES = 1000000;
+const uint32_t BATCH_STEP = 10000;
+
+// A synthetic ROM that runs `body` KERNEL_REPEAT times back to back, then
+// jumps back to the start of the loop. `setup` runs once before the loop.
+// SUPER-CHIP kernels run as SUPER-CHIP unless XO-CHIP was selected.
+struct Kernel {
+  char const *name;
+  std::vector<uint16_t> setup;
+  std::vector<uint16_t> body;
+  bool superChip{false};
+};
+
+std::vector<Kernel> const kernels = {
+    {"00E0 clear", {}, {0x00E0}},
+    {"1nnn jump", {}, {}},
+    {"2nnn/00EE call", {}, {}},
+    // Skips are arranged so none is taken, except ExA1 which skips a load
+    {"3xkk/4xkk skip", {0x6001}, {0x3002, 0x4001}},
+    {"5xy0/9xy0 skip", {0x6001, 0x6102}, {0x5010, 0x9000}},
+    {"6xkk/7xkk load", {}, {0x6012, 0x7103}},
+    {"8xy0-8xy3 logic", {0x6155}, {0x8010, 0x8011, 0x8012, 0x8013}},
+    {"8xy4-8xyE arith", {0x6155}, {0x8014, 0x8015, 0x8016, 0x8017, 0x801E}},
+    {"Annn index", {}, {0xA300}},
+    {"Cxkk random", {}, {0xC0FF}},
+    {"Dxyn draw", {0xA050, 0x6008, 0x6104}, {0xD015}},
+    {"Ex9E/ExA1 key", {}, {0xE09E, 0xE0A1, 0x6000}},
+    {"Fx07/Fx15/Fx18 timer", {}, {0xF007, 0xF015, 0xF018}},
+    {"Fx1E/Fx29 index", {}, {0xF01E, 0xF029}},
+    {"Fx33 bcd", {0xA300, 0x60FF}, {0xF033}},
+    // I is reset, as some variants advance it past the stored registers
+    {"Fx55/Fx65 store", {}, {0xA300, 0xF555, 0xA300, 0xF565}},
+    {"Dxy0 hires draw", {0x00FF, 0xA0A0, 0x6078, 0x613C}, {0xD010}, true},
+    {"00Cn/00FB/00FC scroll", {0x00FF}, {0x00C1, 0x00FB, 0x00FC}, true},
+};
+
+Variant KernelVariant(Kernel const &kernel, Variant variant) {
+  if (kernel.superChip && variant != Variant::XoChip) {
+    return Variant::SuperChip;
+  }
+  return variant;
+}
+
+std::vector<uint8_t> AssembleKernel(Kernel const &kernel) {
+  std::vector<uint16_t> words = kernel.setup;
+  uint16_t loopAddress = 0x200 + 2 * words.size();
+
+  if (std::strcmp(kernel.name, "1nnn jump") == 0) {
+    // Each jump goes to the next, so the loop is too long to be skipped as
+    // an idle loop
+    for (unsigned int i = 0; i < KERNEL_REPEAT; ++i) {
+      words.push_back(0x1000 | (0x200 + 2 * words.size() + 2));
+    }
+    words.push_back(0x1000 | loopAddress);
+  } else if (std::strcmp(kernel.name, "2nnn/00EE call") == 0) {
+    // call -> return -> jump back
+    words.push_back(0x2000 | (loopAddress + 4));
+    words.push_back(0x1000 | loopAddress);
+    words.push_back(0x00EE);
+  } else {
+    for (unsigned int i = 0; i < KERNEL_REPEAT; ++i) {
+      words.insert(words.end(), kernel.body.begin(), kernel.body.end());
+    }
+    words.push_back(0x1000 | loopAddress);
+  }
+
+  std::vector<uint8_t> rom;
+  for (uint16_t word : words) {
+    rom.push_back(word >> 8u);
+    rom.push_back(word & 0xFFu);
+  }
+  return rom;
+}
+
+// With a trace file, the time includes writing out the whole trace
+double RunCycles(Chip8 &chip8, uint64_t cycles, char const *traceFilename) {
+  TraceWriter tracer;
+  std::string error;
+  if (traceFilename) {
+    if (!tracer.Open(traceFilename, chip8.GetVariant(), error)) {
+      std::cerr << error << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+    chip8.SetTracer(&tracer);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  while (cycles > 0) {
+    uint32_t batch = cycles < UINT32_MAX ? cycles : UINT32_MAX;
+    chip8.RunCycles(batch);
+    cycles -= batch;
+  }
+  if (traceFilename && !tracer.Close()) {
+    std::cerr << "Could not write " << traceFilename << "\n";
+    std::exit(EXIT_FAILURE);
+  }
+  chip8.SetTracer(nullptr);
+
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+void Report(char const *name, uint64_t cycles, double seconds) {
+  std::printf("%-28s %12.0f instr/s %8.2f ns/instr\n", name,
+              cycles / seconds, seconds * 1e9 / cycles);
+}
+
+#ifdef CHIP8_PROFILE
+void ReportProfile(Profiler const &profiler) {
+  uint64_t instructions = profiler.Instructions();
+  uint64_t totalTicks = 0;
+  std::vector<Profiler::OpcodeStats> opcodes = profiler.Opcodes();
+  for (Profiler::OpcodeStats const &stats : opcodes) {
+    totalTicks += stats.ticks;
+  }
+
+  for (size_t i = 0; i < opcodes.size() && i < 8; ++i) {
+    std::printf("    %-8s %5.1f%% of instructions %5.1f%% of time\n",
+                opcodes[i].mnemonic, 100.0 * opcodes[i].count / instructions,
+                totalTicks ? 100.0 * opcodes[i].ticks / totalTicks : 0.0);
+  }
+  for (Profiler::Loop const &loop : profiler.HotLoops(3)) {
+    std::printf("    loop %03X-%03X %5.1f%% of instructions\n", loop.start,
+                loop.end, 100.0 * loop.instructions / instructions);
+  }
+}
+#endif
+
+void Usage(char const *program) {
+  std::cerr << "Usage: " << program
+            << " [--cycles N] [--engine interpreter|recompiler]"
+               " [--variant chip8|chip48|schip|xochip]"
+               " [--dispatch cached|switch|goto|table] [--batch N]"
+               " [ROM...]\n"
+               "       "
+            << program << " [options] --trace FILE ROM\n";
+  std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint64_t cycles = DEFAULT_CYCLES;
+  Engine engine = Engine::Interpreter;
+  Variant variant = Variant::CosmacVip;
+  Dispatch dispatch = Chip8(1).GetDispatch();
+  size_t batchSize = 0;
+  char const *traceFilename = nullptr;
+  std::vector<char const *> roms;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+      cycles = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc &&
+               std::strcmp(argv[i + 1], "interpreter") == 0) {
+      engine = Engine::Interpreter;
+      ++i;
+    } else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc &&
+               std::strcmp(argv[i + 1], "recompiler") == 0) {
+      engine = Engine::Recompiler;
+      ++i;
+    } else if (std::strcmp(argv[i], "--variant") == 0 && i + 1 < argc &&
+               ParseVariant(argv[i + 1], variant)) {
+      ++i;
+    } else if (std::strcmp(argv[i], "--dispatch") == 0 && i + 1 < argc &&
+               ParseDispatch(argv[i + 1], dispatch)) {
+      ++i;
+    } else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+      batchSize = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      traceFilename = argv[++i];
+    } else if (argv[i][0] == '-') {
+      Usage(argv[0]);
+    } else {
+      roms.push_back(argv[i]);
+    }
+  }
+
+  // A trace file holds one run
+  if (traceFilename && roms.size() != 1) {
+    Usage(argv[0]);
+  }
+
+  if (!roms.empty()) {
+    std::printf("ROM corpus, %llu cycles each\n", (unsigned long long)cycles);
+
+    uint64_t totalCycles = 0;
+    double totalSeconds = 0;
+
+    for (char const *rom : roms) {
+      Chip8 chip8;
+      chip8.SetEngine(engine);
+      chip8.SetVariant(variant);
+      chip8.SetDispatch(dispatch);
+      // Every cycle timed is an instruction run, not an idle loop skipped
+      chip8.SetSkipIdle(false);
+
+      std::string error;
+      if (!chip8.LoadROM(rom, error)) {
+        std::cerr << error << "\n";
+        continue;
+      }
+
+#ifdef CHIP8_PROFILE
+      Profiler profiler;
+      chip8.SetProfiler(&profiler);
+#endif
+
+      double seconds = RunCycles(chip8, cycles, traceFilename);
+      Report(rom, cycles, seconds);
+#ifdef CHIP8_PROFILE
+      ReportProfile(profiler);
+#endif
+
+      totalCycles += cycles;
+      totalSeconds += seconds;
+    }
+
+    if (totalCycles > 0) {
+      Report("total", totalCycles, totalSeconds);
+    }
+    std::printf("\n");
+  }
+
+  if (traceFilename) {
+    return 0;
+  }
+
+  std::printf("Opcode classes, %llu cycles each, %s dispatch\n",
+              (unsigned long long)KERNEL_CYCLES, DispatchName(dispatch));
+
+  for (Kernel const &kernel : kernels) {
+    std::vector<uint8_t> rom = AssembleKernel(kernel);
+
+    Chip8 chip8;
+    chip8.SetEngine(engine);
+    chip8.SetVariant(KernelVariant(kernel, variant));
+    chip8.SetDispatch(dispatch);
+    chip8.SetSkipIdle(false);
+    chip8.LoadROM(rom.data(), rom.size());
+
+    Report(kernel.name, KERNEL_CYCLES,
+           RunCycles(chip8, KERNEL_CYCLES, nullptr));
+  }
+
+  if (batchSize > 0) {
+    // Every instance runs one of the opcode class kernels
+    ThreadPool pool;
+    Batch batch(batchSize, pool, 1);
+
+    for (size_t i = 0; i < batchSize; ++i) {
+      Kernel const &kernel = kernels[i % kernels.size()];
+      std::vector<uint8_t> rom = AssembleKernel(kernel);
+      batch.Instance(i).SetEngine(engine);
+      batch.Instance(i).SetVariant(KernelVariant(kernel, variant));
+      batch.Instance(i).SetDispatch(dispatch);
+      batch.Instance(i).SetSkipIdle(false);
+      batch.Instance(i).LoadROM(rom.data(), rom.size());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t done = 0; done < BATCH_CYCLES; done += BATCH_STEP) {
+      batch.StepCycles(BATCH_STEP);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::printf("\nBatch of %zu instances on %u threads, %llu cycles each\n",
+                batchSize, pool.Size(), (unsigned long long)BATCH_CYCLES);
+    Report("batch total", batchSize * BATCH_CYCLES,
+           std::chrono::duration<double>(end - start).count());
+  }
+
+  return 0;
+}
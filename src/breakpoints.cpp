@@ -0,0 +1,75 @@
+#include "../headers/breakpoints.h"
+#include <cstring>
+
+namespace {
+
+void SetBit(uint64_t *bits, uint32_t bit, bool set) {
+  uint64_t mask = uint64_t(1) << (bit % 64u);
+  bits[bit / 64u] = set ? bits[bit / 64u] | mask : bits[bit / 64u] & ~mask;
+}
+
+bool AnySet(uint64_t const *bits, size_t words) {
+  for (size_t i = 0; i < words; ++i) {
+    if (bits[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+Breakpoints::Breakpoints() { Clear(); }
+
+void Breakpoints::SetBreakpoint(uint16_t address, bool set) {
+  SetBit(code, address & (CODE_MEMORY - 1u), set);
+}
+
+void Breakpoints::SetOpcodeBreakpoint(uint16_t pattern, uint16_t mask,
+                                      bool set) {
+  for (uint32_t opcode = 0; opcode < OPCODES; ++opcode) {
+    if ((opcode & mask) == (pattern & mask)) {
+      SetBit(opcodes, opcode, set);
+    }
+  }
+}
+
+void Breakpoints::SetWatchpoint(uint16_t first, uint32_t length,
+                                Access access, bool set) {
+  length = length < MEMORY ? length : MEMORY;
+  for (uint32_t i = 0; i < length; ++i) {
+    uint32_t address = (first + i) & (MEMORY - 1u);
+    if (unsigned(access) & unsigned(Access::Read)) {
+      SetBit(reads, address, set);
+    }
+    if (unsigned(access) & unsigned(Access::Write)) {
+      SetBit(writes, address, set);
+    }
+  }
+}
+
+void Breakpoints::Clear() {
+  memset(code, 0, sizeof(code));
+  memset(opcodes, 0, sizeof(opcodes));
+  memset(reads, 0, sizeof(reads));
+  memset(writes, 0, sizeof(writes));
+  hit = {StopReason::Budget, 0, 0, 0, Access::Read};
+}
+
+bool Breakpoints::Empty() const {
+  return !AnySet(code, CODE_MEMORY / 64) && !AnySet(opcodes, OPCODES / 64) &&
+         !AnySet(reads, MEMORY / 64) && !AnySet(writes, MEMORY / 64);
+}
+
+bool Breakpoints::Watched(uint16_t first, uint32_t length, Access access,
+                          uint16_t &address) const {
+  uint64_t const *bits = access == Access::Write ? writes : reads;
+  for (uint32_t i = 0; i < length; ++i) {
+    uint16_t byte = (first + i) & (MEMORY - 1u);
+    if ((bits[byte / 64u] >> (byte % 64u)) & 1u) {
+      address = byte;
+      return true;
+    }
+  }
+  return false;
+}
@@ -1,14 +1,42 @@
 #include "../headers/chip8.h"
+#include "../headers/breakpoints.h"
+#include "../headers/hash.h"
+#include "../headers/mapped_file.h"
+#ifdef CHIP8_PROFILE
+#include "../headers/profiler.h"
+#endif
+#include "../headers/recompiler.h"
+#include "../headers/trace_log.h"
+#include <array>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <fstream>
-#include <random>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-const unsigned int START_ADDRESS = 0x200;
 const unsigned int FONTSIZE = 80;
 const unsigned int FONTSET_START_ADDRESS = 0x50;
+const unsigned int BIG_FONTSIZE = 160;
+const unsigned int BIG_FONTSET_START_ADDRESS = 0xA0;
+// Longest idle loop looked for, in instructions
+const uint32_t IDLE_LOOP_LENGTH = 8;
+// Memory is compared a page at a time when restoring a state
+const unsigned int STATE_PAGE = 256;
+
+// Chosen at build time with CHIP8_DISPATCH
+#if defined(CHIP8_DISPATCH_SWITCH)
+const Dispatch DEFAULT_DISPATCH = Dispatch::Switch;
+#elif defined(CHIP8_DISPATCH_GOTO)
+const Dispatch DEFAULT_DISPATCH = Dispatch::Threaded;
+#elif defined(CHIP8_DISPATCH_TABLE)
+const Dispatch DEFAULT_DISPATCH = Dispatch::Table;
+#else
+const Dispatch DEFAULT_DISPATCH = Dispatch::Cached;
+#endif
 
 uint8_t fontset[FONTSIZE] = {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -28,228 +56,1759 @@ uint8_t fontset[FONTSIZE] = {
     0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
     0xF0, 0x80, 0xF0, 0x80, 0x80, // F
 };
+
+// 8x10 digits for Fx30
+uint8_t bigFontset[BIG_FONTSIZE] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0, // F
+};
+
+namespace {
+
+// RGBA8888 colours for plane 1 only, plane 2 only and both
+const uint32_t PALETTE[4] = {0x00000000, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF};
+
+// Repeats every bit of a 32-bit value, widening a low resolution half row
+uint64_t DoubleBits(uint64_t value) {
+  value = (value | value << 16u) & 0x0000FFFF0000FFFFu;
+  value = (value | value << 8u) & 0x00FF00FF00FF00FFu;
+  value = (value | value << 4u) & 0x0F0F0F0F0F0F0F0Fu;
+  value = (value | value << 2u) & 0x3333333333333333u;
+  value = (value | value << 1u) & 0x5555555555555555u;
+  return value | value << 1u;
+}
+
+struct DispatchNameEntry {
+  Dispatch dispatch;
+  char const *name;
+};
+
+DispatchNameEntry const dispatchNames[] = {
+    {Dispatch::Cached, "cached"},
+    {Dispatch::Switch, "switch"},
+    {Dispatch::Threaded, "goto"},
+    {Dispatch::Table, "table"},
+};
+
+char const *const faultNames[] = {"none", "invalid opcode", "stack overflow",
+                                  "stack underflow"};
+
+char const *const stopReasonNames[] = {"budget",     "draw",
+                                       "key wait",   "fault",
+                                       "breakpoint", "watchpoint"};
+
+} // namespace
+
+char const *FaultName(Fault fault) {
+  return faultNames[static_cast<int>(fault)];
+}
+
+char const *StopReasonName(StopReason reason) {
+  return stopReasonNames[static_cast<int>(reason)];
+}
+
+char const *DispatchName(Dispatch dispatch) {
+  for (DispatchNameEntry const &entry : dispatchNames) {
+    if (entry.dispatch == dispatch) {
+      return entry.name;
+    }
+  }
+  return "unknown";
+}
+
+bool ParseDispatch(char const *name, Dispatch &dispatch) {
+  for (DispatchNameEntry const &entry : dispatchNames) {
+    if (std::strcmp(entry.name, name) == 0) {
+      dispatch = entry.dispatch;
+      return true;
+    }
+  }
+  return false;
+}
+
 Chip8::Chip8()
-    : randGen(std::chrono::system_clock::now().time_since_epoch().count()) {
+    : Chip8(std::chrono::system_clock::now().time_since_epoch().count()) {}
+
+Chip8::Chip8(uint32_t seed, Variant variant) {
 
   pc = START_ADDRESS;
+  dispatch = DEFAULT_DISPATCH;
 
   for (unsigned int i = 0; i < FONTSIZE; i++) {
     memory[FONTSET_START_ADDRESS + i] = fontset[i];
   }
 
-  randByte = std::uniform_int_distribution<uint8_t>(0, 255U);
+  for (unsigned int i = 0; i < BIG_FONTSIZE; i++) {
+    memory[BIG_FONTSET_START_ADDRESS + i] = bigFontset[i];
+  }
+
+  Seed(seed);
 
-  table[0x0] = &Chip8::Table0;
-  table[0x1] = &Chip8::OP_1nnn;
-  table[0x2] = &Chip8::OP_2nnn;
-  table[0x3] = &Chip8::OP_3xkk;
-  table[0x4] = &Chip8::OP_4xkk;
-  table[0x5] = &Chip8::OP_5xy0;
-  table[0x6] = &Chip8::OP_6xkk;
-  table[0x7] = &Chip8::OP_7xkk;
-  table[0x8] = &Chip8::Table8;
-  table[0x9] = &Chip8::OP_9xy0;
-  table[0xA] = &Chip8::OP_Annn;
-  table[0xB] = &Chip8::OP_Bnnn;
-  table[0xC] = &Chip8::OP_Cxkk;
-  table[0xD] = &Chip8::OP_Dxyn;
-  table[0xE] = &Chip8::TableE;
-  table[0xF] = &Chip8::TableF;
+  // Until a program loads its own, the pattern is a 500 Hz square wave
+  memset(audioPattern, 0xF0, sizeof(audioPattern));
 
-  for (size_t i = 0; i <= 0xE; i++) {
-    table0[i] = &Chip8::OP_NULL;
-    table8[i] = &Chip8::OP_NULL;
-    tableE[i] = &Chip8::OP_NULL;
+  for (size_t i = 0; i <= 0xF; i++) {
+    table8[i] = &Chip8::Invoke<&Chip8::OP_NULL>;
+    tableE[i] = &Chip8::Invoke<&Chip8::OP_NULL>;
   }
 
-  table0[0x0] = &Chip8::OP_00E0;
-  table0[0xE] = &Chip8::OP_00EE;
+  // Opcodes 0, 5, 8, E and F are resolved through the sub-tables in Decode()
+  // and those left null here depend on the variant
+  table[0x0] = nullptr;
+  table[0x1] = &Chip8::Invoke<&Chip8::OP_1nnn>;
+  table[0x2] = &Chip8::Invoke<&Chip8::OP_2nnn>;
+  table[0x3] = nullptr;
+  table[0x4] = nullptr;
+  table[0x5] = nullptr;
+  table[0x6] = &Chip8::Invoke<&Chip8::OP_6xkk>;
+  table[0x7] = &Chip8::Invoke<&Chip8::OP_7xkk>;
+  table[0x8] = nullptr;
+  table[0x9] = nullptr;
+  table[0xA] = &Chip8::Invoke<&Chip8::OP_Annn>;
+  table[0xB] = nullptr;
+  table[0xC] = &Chip8::Invoke<&Chip8::OP_Cxkk>;
+  table[0xD] = nullptr;
+  table[0xE] = nullptr;
+  table[0xF] = nullptr;
+
+  table8[0x0] = &Chip8::Invoke<&Chip8::OP_8xy0>;
+  table8[0x4] = &Chip8::Invoke<&Chip8::OP_8xy4>;
+  table8[0x5] = &Chip8::Invoke<&Chip8::OP_8xy5>;
+  table8[0x7] = &Chip8::Invoke<&Chip8::OP_8xy7>;
+
+  for (size_t i = 0; i <= 0xFF; i++) {
+    table0[i] = &Chip8::Invoke<&Chip8::OP_NULL>;
+    tableF[i] = &Chip8::Invoke<&Chip8::OP_NULL>;
+  }
+
+  table0[0xE0] = &Chip8::Invoke<&Chip8::OP_00E0>;
+  table0[0xEE] = &Chip8::Invoke<&Chip8::OP_00EE>;
+
+  tableF[0x07] = &Chip8::Invoke<&Chip8::OP_Fx07>;
+  tableF[0x0A] = &Chip8::Invoke<&Chip8::OP_Fx0A>;
+  tableF[0x15] = &Chip8::Invoke<&Chip8::OP_Fx15>;
+  tableF[0x18] = &Chip8::Invoke<&Chip8::OP_Fx18>;
+  tableF[0x1E] = &Chip8::Invoke<&Chip8::OP_Fx1E>;
+  tableF[0x29] = &Chip8::Invoke<&Chip8::OP_Fx29>;
+  tableF[0x33] = &Chip8::Invoke<&Chip8::OP_Fx33>;
 
-  table8[0x0] = &Chip8::OP_8xy0;
-  table8[0x1] = &Chip8::OP_8xy1;
-  table8[0x2] = &Chip8::OP_8xy2;
-  table8[0x3] = &Chip8::OP_8xy3;
-  table8[0x4] = &Chip8::OP_8xy4;
-  table8[0x5] = &Chip8::OP_8xy5;
-  table8[0x6] = &Chip8::OP_8xy6;
-  table8[0x7] = &Chip8::OP_8xy7;
-  table8[0xE] = &Chip8::OP_8xyE;
+  SetVariant(variant);
+}
+
+Chip8::~Chip8() = default;
+
+template <typename Quirks> void Chip8::UseQuirks() {
+  bool const superChip = Quirks::superChipOps;
+  bool const xoChip = Quirks::xoChipOps;
+  // Instructions the variant lacks raise Fault::InvalidOpcode
+  Handler const none = &Chip8::Invoke<&Chip8::OP_NULL>;
+
+  table[0x3] = &Chip8::Invoke<&Chip8::OP_3xkk<xoChip>>;
+  table[0x4] = &Chip8::Invoke<&Chip8::OP_4xkk<xoChip>>;
+  table[0x9] = &Chip8::Invoke<&Chip8::OP_9xy0<xoChip>>;
+  table[0xB] = &Chip8::Invoke<&Chip8::OP_Bnnn<Quirks::jumpUsesVx>>;
+  table[0xD] =
+      &Chip8::Invoke<&Chip8::OP_Dxyn<Quirks::spritesWrap, superChip>>;
+
+  for (size_t n = 0; n <= 0xF; n++) {
+    table0[0xC0 + n] = superChip ? &Chip8::Invoke<&Chip8::OP_00Cn> : none;
+    table0[0xD0 + n] = xoChip ? &Chip8::Invoke<&Chip8::OP_00Dn> : none;
+    table5[n] = &Chip8::Invoke<&Chip8::OP_5xy0<xoChip>>;
+  }
 
-  tableE[0x1] = &Chip8::OP_ExA1;
-  tableE[0xE] = &Chip8::OP_Ex9E;
+  table0[0xFB] = superChip ? &Chip8::Invoke<&Chip8::OP_00FB> : none;
+  table0[0xFC] = superChip ? &Chip8::Invoke<&Chip8::OP_00FC> : none;
+  table0[0xFD] = superChip ? &Chip8::Invoke<&Chip8::OP_00FD> : none;
+  table0[0xFE] = superChip ? &Chip8::Invoke<&Chip8::OP_00FE> : none;
+  table0[0xFF] = superChip ? &Chip8::Invoke<&Chip8::OP_00FF> : none;
 
-  for (size_t i = 0; i <= 0x65; i++) {
-    tableF[i] = &Chip8::OP_NULL;
+  if (xoChip) {
+    table5[0x2] = &Chip8::Invoke<&Chip8::OP_5xy2>;
+    table5[0x3] = &Chip8::Invoke<&Chip8::OP_5xy3>;
   }
 
-  tableF[0x07] = &Chip8::OP_Fx07;
-  tableF[0x0A] = &Chip8::OP_Fx0A;
-  tableF[0x15] = &Chip8::OP_Fx15;
-  tableF[0x18] = &Chip8::OP_Fx18;
-  tableF[0x1E] = &Chip8::OP_Fx1E;
-  tableF[0x29] = &Chip8::OP_Fx29;
-  tableF[0x33] = &Chip8::OP_Fx33;
-  tableF[0x55] = &Chip8::OP_Fx55;
-  tableF[0x65] = &Chip8::OP_Fx65;
+  table8[0x1] = &Chip8::Invoke<&Chip8::OP_8xy1<Quirks::logicResetsVF>>;
+  table8[0x2] = &Chip8::Invoke<&Chip8::OP_8xy2<Quirks::logicResetsVF>>;
+  table8[0x3] = &Chip8::Invoke<&Chip8::OP_8xy3<Quirks::logicResetsVF>>;
+  table8[0x6] = &Chip8::Invoke<&Chip8::OP_8xy6<Quirks::shiftUsesVy>>;
+  table8[0xE] = &Chip8::Invoke<&Chip8::OP_8xyE<Quirks::shiftUsesVy>>;
+
+  tableE[0x1] = &Chip8::Invoke<&Chip8::OP_ExA1<xoChip>>;
+  tableE[0xE] = &Chip8::Invoke<&Chip8::OP_Ex9E<xoChip>>;
+
+  tableF[0x00] = xoChip ? &Chip8::Invoke<&Chip8::OP_F000> : none;
+  tableF[0x01] = xoChip ? &Chip8::Invoke<&Chip8::OP_Fn01> : none;
+  tableF[0x02] = xoChip ? &Chip8::Invoke<&Chip8::OP_F002> : none;
+  tableF[0x30] = superChip ? &Chip8::Invoke<&Chip8::OP_Fx30> : none;
+  tableF[0x3A] = xoChip ? &Chip8::Invoke<&Chip8::OP_Fx3A> : none;
+  tableF[0x55] = &Chip8::Invoke<&Chip8::OP_Fx55<Quirks::loadStoreStep>>;
+  tableF[0x65] = &Chip8::Invoke<&Chip8::OP_Fx65<Quirks::loadStoreStep>>;
+  tableF[0x75] = superChip ? &Chip8::Invoke<&Chip8::OP_Fx75> : none;
+  tableF[0x85] = superChip ? &Chip8::Invoke<&Chip8::OP_Fx85> : none;
 }
 
-void Chip8::LoadROM(char const *filename) {
-  std::ifstream file(filename, std::ios::binary | std::ios::ate);
-  if (file.is_open()) {
-    std::streampos size = file.tellg();
-    char *buffer = new char[size];
-    file.seekg(0, std::ios::beg);
-    file.read(buffer, size);
-    file.close();
+void Chip8::SetVariant(Variant variant) {
+  this->variant = variant;
+
+  switch (variant) {
+  case Variant::CosmacVip:
+    UseQuirks<CosmacVipQuirks>();
+    break;
+  case Variant::Chip48:
+    UseQuirks<Chip48Quirks>();
+    break;
+  case Variant::SuperChip:
+    UseQuirks<SuperChipQuirks>();
+    break;
+  case Variant::XoChip:
+    UseQuirks<XoChipQuirks>();
+    break;
+  }
+
+  // Cached instructions still point at the previous handlers
+  memset(decoded, 0, sizeof(decoded));
+  ++codeGeneration;
+}
+
+void Chip8::SetStopOnFault(bool stop) {
+  if (stop != stopOnFault) {
+    stopOnFault = stop;
+    // Recompiled blocks only end at invalid opcodes while faults stop
+    ++codeGeneration;
+  }
+}
 
-    for (long i = 0; i < size; i++) {
-      memory[START_ADDRESS + i] = buffer[i];
+void Chip8::SetEngine(Engine engine) {
+  this->engine = engine;
+
+  if (engine == Engine::Recompiler && !recompiler &&
+      Recompiler::Supported()) {
+    recompiler = std::make_unique<Recompiler>(*this);
+  }
+}
+
+StopReason Chip8::RunCycles(uint32_t count) {
+#ifdef CHIP8_PROFILE
+  bool native = !profiler;
+#else
+  bool native = true;
+#endif
+
+  waiting = Wait::None;
+  stopReason = StopReason::Budget;
+  stopLeft = 0;
+
+  if (breakpoints) {
+    switch (variant) {
+    case Variant::CosmacVip:
+      stopLeft = RunChecked<CosmacVipQuirks>(count);
+      break;
+    case Variant::Chip48:
+      stopLeft = RunChecked<Chip48Quirks>(count);
+      break;
+    case Variant::SuperChip:
+      stopLeft = RunChecked<SuperChipQuirks>(count);
+      break;
+    case Variant::XoChip:
+      stopLeft = RunChecked<XoChipQuirks>(count);
+      break;
     }
+    return Stopped();
+  }
+  // Running on unchecked moves past the instruction a stop was before
+  resumed = StopReason::Budget;
 
-    delete[] buffer;
+  if (tracer) {
+    stopLeft = RunTraced(count);
+    return Stopped();
+  }
+
+  if (native && engine == Engine::Recompiler && recompiler) {
+    stopLeft = recompiler->Run(count);
+    return Stopped();
+  }
+
+#ifdef CHIP8_PROFILE
+  if (profiler) {
+    // Idle loops are left to run, so the profile shows them
+    profiler->Enter(pc);
+    for (uint32_t i = 0; i < count; i++) {
+      Cycle();
+      if (stopReason != StopReason::Budget) {
+        stopLeft = count - i - 1;
+        break;
+      }
+    }
+    profiler->Leave(pc);
+    return Stopped();
+  }
+#endif
+
+  // Stop() hands whatever is left here over to stopLeft
+  cyclesLeft = count;
+  if (dispatch == Dispatch::Cached) {
+    while (cyclesLeft > 0) {
+      --cyclesLeft;
+      Cycle();
+    }
+    return Stopped();
+  }
+
+  switch (variant) {
+  case Variant::CosmacVip:
+    RunDispatched<CosmacVipQuirks>();
+    break;
+  case Variant::Chip48:
+    RunDispatched<Chip48Quirks>();
+    break;
+  case Variant::SuperChip:
+    RunDispatched<SuperChipQuirks>();
+    break;
+  case Variant::XoChip:
+    RunDispatched<XoChipQuirks>();
+    break;
+  }
+  return Stopped();
+}
+
+StopReason Chip8::Stopped() const {
+  if (stopReason == StopReason::Budget && waiting == Wait::Keypad) {
+    return StopReason::KeyWait;
+  }
+  return stopReason;
+}
+
+// The handler Decode() would pick for `opcode` under Quirks, for building
+// tables at compile time
+template <typename Quirks>
+constexpr Chip8::Handler Chip8::HandlerFor(uint16_t opcode) {
+  constexpr bool superChip = Quirks::superChipOps;
+  constexpr bool xoChip = Quirks::xoChipOps;
+  constexpr IndexStep step = Quirks::loadStoreStep;
+  Handler const none = &Invoke<&Chip8::OP_NULL>;
+  uint8_t const kk = opcode & 0xFFu;
+  uint8_t const n = opcode & 0xFu;
+
+  switch (opcode >> 12u) {
+  case 0x0:
+    if (kk == 0xE0) {
+      return &Invoke<&Chip8::OP_00E0>;
+    } else if (kk == 0xEE) {
+      return &Invoke<&Chip8::OP_00EE>;
+    } else if (!superChip) {
+      return none;
+    } else if ((kk & 0xF0u) == 0xC0) {
+      return &Invoke<&Chip8::OP_00Cn>;
+    } else if ((kk & 0xF0u) == 0xD0) {
+      return xoChip ? &Invoke<&Chip8::OP_00Dn> : none;
+    }
+    switch (kk) {
+    case 0xFB:
+      return &Invoke<&Chip8::OP_00FB>;
+    case 0xFC:
+      return &Invoke<&Chip8::OP_00FC>;
+    case 0xFD:
+      return &Invoke<&Chip8::OP_00FD>;
+    case 0xFE:
+      return &Invoke<&Chip8::OP_00FE>;
+    case 0xFF:
+      return &Invoke<&Chip8::OP_00FF>;
+    }
+    return none;
+  case 0x1:
+    return &Invoke<&Chip8::OP_1nnn>;
+  case 0x2:
+    return &Invoke<&Chip8::OP_2nnn>;
+  case 0x3:
+    return &Invoke<&Chip8::OP_3xkk<xoChip>>;
+  case 0x4:
+    return &Invoke<&Chip8::OP_4xkk<xoChip>>;
+  case 0x5:
+    if (xoChip && n == 0x2) {
+      return &Invoke<&Chip8::OP_5xy2>;
+    } else if (xoChip && n == 0x3) {
+      return &Invoke<&Chip8::OP_5xy3>;
+    }
+    return &Invoke<&Chip8::OP_5xy0<xoChip>>;
+  case 0x6:
+    return &Invoke<&Chip8::OP_6xkk>;
+  case 0x7:
+    return &Invoke<&Chip8::OP_7xkk>;
+  case 0x8:
+    switch (n) {
+    case 0x0:
+      return &Invoke<&Chip8::OP_8xy0>;
+    case 0x1:
+      return &Invoke<&Chip8::OP_8xy1<Quirks::logicResetsVF>>;
+    case 0x2:
+      return &Invoke<&Chip8::OP_8xy2<Quirks::logicResetsVF>>;
+    case 0x3:
+      return &Invoke<&Chip8::OP_8xy3<Quirks::logicResetsVF>>;
+    case 0x4:
+      return &Invoke<&Chip8::OP_8xy4>;
+    case 0x5:
+      return &Invoke<&Chip8::OP_8xy5>;
+    case 0x6:
+      return &Invoke<&Chip8::OP_8xy6<Quirks::shiftUsesVy>>;
+    case 0x7:
+      return &Invoke<&Chip8::OP_8xy7>;
+    case 0xE:
+      return &Invoke<&Chip8::OP_8xyE<Quirks::shiftUsesVy>>;
+    }
+    return none;
+  case 0x9:
+    return &Invoke<&Chip8::OP_9xy0<xoChip>>;
+  case 0xA:
+    return &Invoke<&Chip8::OP_Annn>;
+  case 0xB:
+    return &Invoke<&Chip8::OP_Bnnn<Quirks::jumpUsesVx>>;
+  case 0xC:
+    return &Invoke<&Chip8::OP_Cxkk>;
+  case 0xD:
+    return &Invoke<&Chip8::OP_Dxyn<Quirks::spritesWrap, superChip>>;
+  case 0xE:
+    if (n == 0xE) {
+      return &Invoke<&Chip8::OP_Ex9E<xoChip>>;
+    } else if (n == 0x1) {
+      return &Invoke<&Chip8::OP_ExA1<xoChip>>;
+    }
+    return none;
+  default:
+    switch (kk) {
+    case 0x00:
+      return xoChip ? &Invoke<&Chip8::OP_F000> : none;
+    case 0x01:
+      return xoChip ? &Invoke<&Chip8::OP_Fn01> : none;
+    case 0x02:
+      return xoChip ? &Invoke<&Chip8::OP_F002> : none;
+    case 0x07:
+      return &Invoke<&Chip8::OP_Fx07>;
+    case 0x0A:
+      return &Invoke<&Chip8::OP_Fx0A>;
+    case 0x15:
+      return &Invoke<&Chip8::OP_Fx15>;
+    case 0x18:
+      return &Invoke<&Chip8::OP_Fx18>;
+    case 0x1E:
+      return &Invoke<&Chip8::OP_Fx1E>;
+    case 0x29:
+      return &Invoke<&Chip8::OP_Fx29>;
+    case 0x30:
+      return superChip ? &Invoke<&Chip8::OP_Fx30> : none;
+    case 0x33:
+      return &Invoke<&Chip8::OP_Fx33>;
+    case 0x3A:
+      return xoChip ? &Invoke<&Chip8::OP_Fx3A> : none;
+    case 0x55:
+      return &Invoke<&Chip8::OP_Fx55<step>>;
+    case 0x65:
+      return &Invoke<&Chip8::OP_Fx65<step>>;
+    case 0x75:
+      return superChip ? &Invoke<&Chip8::OP_Fx75> : none;
+    case 0x85:
+      return superChip ? &Invoke<&Chip8::OP_Fx85> : none;
+    }
+    return none;
+  }
+}
+
+// The dispatches other than Cached fetch every instruction and resolve its
+// handler from the opcode each time. They are compiled once per quirk
+// policy, so the choice of handler folds into the dispatch itself.
+template <typename Quirks> void Chip8::RunDispatched() {
+  switch (dispatch) {
+  case Dispatch::Cached:
+    break;
+  case Dispatch::Switch:
+    RunSwitch<Quirks>();
+    break;
+  case Dispatch::Threaded:
+    RunThreaded<Quirks>();
+    break;
+  case Dispatch::Table:
+    RunTable<Quirks>();
+    break;
+  }
+}
+
+template <typename Quirks> void Chip8::RunSwitch() {
+  Instruction op;
+
+  while (cyclesLeft > 0) {
+    --cyclesLeft;
+    Fetch(op, pc & (CODE_MEMORY - 1u));
+    pc += 2;
+    Execute<Quirks>(op);
+  }
+}
+
+template <typename Quirks> void Chip8::RunThreaded() {
+#if defined(__GNUC__)
+  // One label per leading nibble; each ends by fetching the next
+  // instruction and jumping straight to its label
+  static void *const labels[0xF + 1] = {
+      &&group, &&op1nnn, &&op2nnn, &&op3xkk, &&op4xkk, &&group,
+      &&op6xkk, &&op7xkk, &&group, &&op9xy0, &&opAnnn, &&opBnnn,
+      &&opCxkk, &&opDxyn, &&group, &&group};
+  constexpr bool superChip = Quirks::superChipOps;
+  constexpr bool xoChip = Quirks::xoChipOps;
+  Instruction op;
+
+#define DISPATCH()                                                           \
+  if (cyclesLeft == 0) {                                                     \
+    return;                                                                  \
+  }                                                                          \
+  --cyclesLeft;                                                              \
+  Fetch(op, pc & (CODE_MEMORY - 1u));                                        \
+  pc += 2;                                                                   \
+  goto *labels[op.opcode >> 12u]
+
+  DISPATCH();
+group:
+  ExecuteGroup<Quirks>(op);
+  DISPATCH();
+op1nnn:
+  OP_1nnn(op);
+  DISPATCH();
+op2nnn:
+  OP_2nnn(op);
+  DISPATCH();
+op3xkk:
+  OP_3xkk<xoChip>(op);
+  DISPATCH();
+op4xkk:
+  OP_4xkk<xoChip>(op);
+  DISPATCH();
+op6xkk:
+  OP_6xkk(op);
+  DISPATCH();
+op7xkk:
+  OP_7xkk(op);
+  DISPATCH();
+op9xy0:
+  OP_9xy0<xoChip>(op);
+  DISPATCH();
+opAnnn:
+  OP_Annn(op);
+  DISPATCH();
+opBnnn:
+  OP_Bnnn<Quirks::jumpUsesVx>(op);
+  DISPATCH();
+opCxkk:
+  OP_Cxkk(op);
+  DISPATCH();
+opDxyn:
+  OP_Dxyn<Quirks::spritesWrap, superChip>(op);
+  DISPATCH();
+
+#undef DISPATCH
+#else
+  RunSwitch<Quirks>();
+#endif
+}
+
+template <typename Quirks> void Chip8::RunTable() {
+  // The handler depends only on the leading nibble and the low byte, so
+  // each of those 4096 is resolved once and copied to its 16 opcodes
+  static constexpr std::array<Handler, 0x10000> handlers = [] {
+    std::array<Handler, 0x10000> table{};
+    for (uint32_t key = 0; key < 0x1000; ++key) {
+      uint16_t high = (key >> 8u) << 12u;
+      uint16_t low = key & 0xFFu;
+      Handler handler = HandlerFor<Quirks>(high | low);
+      for (uint32_t middle = 0; middle < 0x1000; middle += 0x100) {
+        table[high | middle | low] = handler;
+      }
+    }
+    return table;
+  }();
+  Instruction op;
+
+  while (cyclesLeft > 0) {
+    --cyclesLeft;
+    Fetch(op, pc & (CODE_MEMORY - 1u));
+    pc += 2;
+    handlers[op.opcode](*this, op);
+  }
+}
+
+// Runs `op` as the dispatch tables of Quirks would
+template <typename Quirks> void Chip8::Execute(Instruction const &op) {
+  constexpr bool superChip = Quirks::superChipOps;
+  constexpr bool xoChip = Quirks::xoChipOps;
+
+  switch (op.opcode >> 12u) {
+  case 0x1:
+    OP_1nnn(op);
+    break;
+  case 0x2:
+    OP_2nnn(op);
+    break;
+  case 0x3:
+    OP_3xkk<xoChip>(op);
+    break;
+  case 0x4:
+    OP_4xkk<xoChip>(op);
+    break;
+  case 0x6:
+    OP_6xkk(op);
+    break;
+  case 0x7:
+    OP_7xkk(op);
+    break;
+  case 0x9:
+    OP_9xy0<xoChip>(op);
+    break;
+  case 0xA:
+    OP_Annn(op);
+    break;
+  case 0xB:
+    OP_Bnnn<Quirks::jumpUsesVx>(op);
+    break;
+  case 0xC:
+    OP_Cxkk(op);
+    break;
+  case 0xD:
+    OP_Dxyn<Quirks::spritesWrap, superChip>(op);
+    break;
+  default:
+    ExecuteGroup<Quirks>(op);
+    break;
+  }
+}
+
+// Opcodes 0, 5, 8, E and F, told apart by their low byte or nibble
+template <typename Quirks> void Chip8::ExecuteGroup(Instruction const &op) {
+  constexpr bool superChip = Quirks::superChipOps;
+  constexpr bool xoChip = Quirks::xoChipOps;
+  constexpr IndexStep step = Quirks::loadStoreStep;
+
+  switch (op.opcode >> 12u) {
+  case 0x0:
+    if (op.kk == 0xE0) {
+      OP_00E0(op);
+    } else if (op.kk == 0xEE) {
+      OP_00EE(op);
+    } else if (!superChip) {
+      OP_NULL(op);
+    } else if ((op.kk & 0xF0u) == 0xC0) {
+      OP_00Cn(op);
+    } else if ((op.kk & 0xF0u) == 0xD0 && xoChip) {
+      OP_00Dn(op);
+    } else if (op.kk == 0xFB) {
+      OP_00FB(op);
+    } else if (op.kk == 0xFC) {
+      OP_00FC(op);
+    } else if (op.kk == 0xFD) {
+      OP_00FD(op);
+    } else if (op.kk == 0xFE) {
+      OP_00FE(op);
+    } else if (op.kk == 0xFF) {
+      OP_00FF(op);
+    } else {
+      OP_NULL(op);
+    }
+    break;
+  case 0x5:
+    if (xoChip && op.n == 0x2) {
+      OP_5xy2(op);
+    } else if (xoChip && op.n == 0x3) {
+      OP_5xy3(op);
+    } else {
+      OP_5xy0<xoChip>(op);
+    }
+    break;
+  case 0x8:
+    switch (op.n) {
+    case 0x0:
+      OP_8xy0(op);
+      break;
+    case 0x1:
+      OP_8xy1<Quirks::logicResetsVF>(op);
+      break;
+    case 0x2:
+      OP_8xy2<Quirks::logicResetsVF>(op);
+      break;
+    case 0x3:
+      OP_8xy3<Quirks::logicResetsVF>(op);
+      break;
+    case 0x4:
+      OP_8xy4(op);
+      break;
+    case 0x5:
+      OP_8xy5(op);
+      break;
+    case 0x6:
+      OP_8xy6<Quirks::shiftUsesVy>(op);
+      break;
+    case 0x7:
+      OP_8xy7(op);
+      break;
+    case 0xE:
+      OP_8xyE<Quirks::shiftUsesVy>(op);
+      break;
+    default:
+      OP_NULL(op);
+      break;
+    }
+    break;
+  case 0xE:
+    if (op.n == 0xE) {
+      OP_Ex9E<xoChip>(op);
+    } else if (op.n == 0x1) {
+      OP_ExA1<xoChip>(op);
+    } else {
+      OP_NULL(op);
+    }
+    break;
+  case 0xF:
+    switch (op.kk) {
+    case 0x00:
+      if (xoChip) {
+        OP_F000(op);
+      } else {
+        OP_NULL(op);
+      }
+      break;
+    case 0x01:
+      if (xoChip) {
+        OP_Fn01(op);
+      } else {
+        OP_NULL(op);
+      }
+      break;
+    case 0x02:
+      if (xoChip) {
+        OP_F002(op);
+      } else {
+        OP_NULL(op);
+      }
+      break;
+    case 0x07:
+      OP_Fx07(op);
+      break;
+    case 0x0A:
+      OP_Fx0A(op);
+      break;
+    case 0x15:
+      OP_Fx15(op);
+      break;
+    case 0x18:
+      OP_Fx18(op);
+      break;
+    case 0x1E:
+      OP_Fx1E(op);
+      break;
+    case 0x29:
+      OP_Fx29(op);
+      break;
+    case 0x30:
+      if (superChip) {
+        OP_Fx30(op);
+      } else {
+        OP_NULL(op);
+      }
+      break;
+    case 0x33:
+      OP_Fx33(op);
+      break;
+    case 0x3A:
+      if (xoChip) {
+        OP_Fx3A(op);
+      } else {
+        OP_NULL(op);
+      }
+      break;
+    case 0x55:
+      OP_Fx55<step>(op);
+      break;
+    case 0x65:
+      OP_Fx65<step>(op);
+      break;
+    case 0x75:
+      if (superChip) {
+        OP_Fx75(op);
+      } else {
+        OP_NULL(op);
+      }
+      break;
+    case 0x85:
+      if (superChip) {
+        OP_Fx85(op);
+      } else {
+        OP_NULL(op);
+      }
+      break;
+    default:
+      OP_NULL(op);
+      break;
+    }
+    break;
+  }
+}
+
+// Returns the cycles a stop left unrun
+uint32_t Chip8::RunTraced(uint32_t count) {
+  // Handlers see no cycles left to fast-forward over
+  cyclesLeft = 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint16_t address = pc;
+    Cycle();
+
+    Instruction const &op = decoded[address & (CODE_MEMORY - 1u)];
+    tracer->Record({address, op.opcode, index, registers[op.x],
+                    registers[0xF]});
+    if (stopReason != StopReason::Budget) {
+      return count - i - 1;
+    }
+  }
+  return 0;
+}
+
+
+// The interpreter with every instruction checked before it runs, traced
+// too when a tracer is attached. Returns the cycles a stop left unrun.
+template <typename Quirks> uint32_t Chip8::RunChecked(uint32_t count) {
+  // Handlers see no cycles left to fast-forward over, so breakpoints in
+  // idle loops are hit
+  cyclesLeft = 0;
+  Instruction op;
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint16_t address = pc;
+    Fetch(op, address & (CODE_MEMORY - 1u));
+    if (Breaks<Quirks>(op, resumed)) {
+      resumed = stopReason;
+      return count - i;
+    }
+    resumed = StopReason::Budget;
+
+    pc += 2;
+    Execute<Quirks>(op);
+    if (tracer) {
+      tracer->Record({address, op.opcode, index, registers[op.x],
+                      registers[0xF]});
+    }
+    if (stopReason != StopReason::Budget) {
+      return count - i - 1;
+    }
+  }
+  return 0;
+}
+
+// Whether a breakpoint or watchpoint stops the machine before `op`, which
+// is at pc, and if so records the hit. Resuming after a breakpoint still
+// checks watchpoints; after a watchpoint, nothing.
+template <typename Quirks>
+bool Chip8::Breaks(Instruction const &op, StopReason resumed) {
+  typedef Breakpoints::Access Access;
+  constexpr bool superChip = Quirks::superChipOps;
+  constexpr bool xoChip = Quirks::xoChipOps;
+  Breakpoints::Hit hit{StopReason::Breakpoint, pc, op.opcode, pc,
+                       Access::Read};
+
+  // The bytes from I the instruction reads or writes, and for draws how
+  // far on the next selected plane's sprite is
+  uint32_t length = 0;
+  uint32_t planeBytes = 0;
+  switch (op.opcode & 0xF0FFu) {
+  case 0xF033:
+    hit.access = Access::Write;
+    length = 3;
+    break;
+  case 0xF055:
+    hit.access = Access::Write;
+    length = op.x + 1u;
+    break;
+  case 0xF065:
+    length = op.x + 1u;
+    break;
+  case 0xF002:
+    length = xoChip ? AUDIO_PATTERN : 0;
+    break;
+  default:
+    if (xoChip && (op.opcode & 0xF00Eu) == 0x5002u) {
+      // 5xy2 stores and 5xy3 loads Vx to Vy, in either order
+      hit.access = op.n == 2 ? Access::Write : Access::Read;
+      length = (op.x < op.y ? op.y - op.x : op.x - op.y) + 1u;
+    } else if (op.opcode >> 12u == 0xD) {
+      // Only the rows drawn are read
+      unsigned int rows = hires ? DISPLAY_Height : LORES_Height;
+      unsigned int yPos = registers[op.y] & (rows - 1u);
+      uint32_t height = op.n;
+      uint32_t rowBytes = 1;
+      if (superChip && height == 0) {
+        height = 16;
+        rowBytes = 2;
+      }
+      uint32_t visible = height;
+      if (!Quirks::spritesWrap && visible > rows - yPos) {
+        visible = rows - yPos;
+      }
+      length = visible * rowBytes;
+      planeBytes = height * rowBytes;
+    }
+    break;
+  }
+
+  bool stops = resumed == StopReason::Budget &&
+               (breakpoints->Breaks(pc) || breakpoints->BreaksOn(op.opcode));
+  if (!stops && resumed != StopReason::Watchpoint && length > 0) {
+    uint16_t first = index;
+    for (unsigned int plane = 0; plane < PLANES && !stops; ++plane) {
+      if (planeBytes > 0 && !(planes & (1u << plane))) {
+        continue;
+      }
+      stops = breakpoints->Watched(first, length, hit.access, hit.address);
+      hit.reason = StopReason::Watchpoint;
+      if (planeBytes == 0) {
+        break;
+      }
+      first += planeBytes;
+    }
+  }
+
+  if (stops) {
+    stopReason = hit.reason;
+    breakpoints->hit = hit;
+  }
+  return stops;
+}
+
+StopReason Chip8::RunFrame(uint32_t instructionsPerFrame) {
+  StopReason reason =
+      RunCycles(frameLeft > 0 ? frameLeft : instructionsPerFrame);
+  frameLeft = stopLeft;
+  if (frameLeft == 0) {
+    TickTimers();
+  }
+  return reason;
+}
+
+// Instructions in one pass of the loop starting at pc if running them would
+// leave the machine exactly as it is, 0 otherwise. Such a loop only reads
+// the keypad, the delay timer and registers it does not write, so until a
+// key changes or the timer ticks every pass repeats the first.
+uint32_t Chip8::IdleLoopLength(Wait &wait) {
+  if (pc >= CODE_MEMORY - 1u) {
+    return 0;
+  }
+
+  // Only the Cached dispatch fills the cache as it goes
+  if (!decoded[pc].handler) {
+    Decode(pc);
+  }
+  Instruction const &first = decoded[pc];
+  if (first.handler == &Invoke<&Chip8::OP_00FD>) {
+    wait = Wait::Forever;
+    return 1;
+  }
+  if (first.handler == &Invoke<&Chip8::OP_Fx0A>) {
+    for (uint8_t key : keypad) {
+      if (key) {
+        return 0;
+      }
+    }
+    wait = Wait::Keypad;
+    return 1;
+  }
+
+  bool timer = false;
+  bool keys = false;
+  uint16_t address = pc;
+
+  for (uint32_t length = 1; length <= IDLE_LOOP_LENGTH; ++length) {
+    if (address >= CODE_MEMORY - 1u) {
+      return 0;
+    }
+
+    if (!decoded[address].handler) {
+      Decode(address);
+    }
+    Instruction const &op = decoded[address];
+    Handler handler = op.handler;
+    bool skip = false;
+    bool longSkip = false;
+
+    // Sorting on the opcode first keeps rejecting a busy loop cheap
+    switch (op.opcode >> 12u) {
+    case 0x1:
+      if (handler != &Invoke<&Chip8::OP_1nnn> || op.nnn != pc) {
+        return 0;
+      }
+      wait = timer ? Wait::DelayTimer : keys ? Wait::Keypad : Wait::Forever;
+      return length;
+    case 0x3:
+      skip = registers[op.x] == op.kk;
+      longSkip = handler == &Invoke<&Chip8::OP_3xkk<true>>;
+      break;
+    case 0x4:
+      skip = registers[op.x] != op.kk;
+      longSkip = handler == &Invoke<&Chip8::OP_4xkk<true>>;
+      break;
+    case 0x5:
+      if (op.n != 0) {
+        return 0;
+      }
+      skip = registers[op.x] == registers[op.y];
+      longSkip = handler == &Invoke<&Chip8::OP_5xy0<true>>;
+      break;
+    case 0x9:
+      if (op.n != 0) {
+        return 0;
+      }
+      skip = registers[op.x] != registers[op.y];
+      longSkip = handler == &Invoke<&Chip8::OP_9xy0<true>>;
+      break;
+    case 0xE: {
+      uint8_t key = registers[op.x] & 0xFu;
+      if (op.kk != 0x9E && op.kk != 0xA1) {
+        return 0;
+      }
+      skip = (keypad[key] != 0) == (op.kk == 0x9E);
+      longSkip = handler == &Invoke<&Chip8::OP_Ex9E<true>> ||
+                 handler == &Invoke<&Chip8::OP_ExA1<true>>;
+      keys = true;
+      break;
+    }
+    case 0xF:
+      // Writes the register, so only idle once it already holds the timer
+      if (op.kk != 0x07 || registers[op.x] != delayTimer) {
+        return 0;
+      }
+      timer = true;
+      break;
+    default:
+      return 0;
+    }
+
+    address += 2;
+    if (skip) {
+      bool wide = longSkip && memory[address] == 0xF0 &&
+                  memory[address + 1u] == 0x00;
+      address += wide ? 4 : 2;
+    }
+  }
+  return 0;
+}
+
+// Skips whole passes of an idle loop at pc, up to `cycles`, and returns how
+// many cycles that was
+uint32_t Chip8::FastForward(uint32_t cycles) {
+  if (!skipIdle) {
+    return 0;
+  }
+
+  Wait wait;
+  uint32_t length = IdleLoopLength(wait);
+  if (length == 0) {
+    return 0;
+  }
+
+  uint32_t skipped = cycles - cycles % length;
+  waiting = wait;
+  idleCycles += skipped;
+  return skipped;
+}
+
+bool Chip8::LoadROM(char const *filename, std::string &error) {
+  MappedFile rom;
+  if (!rom.Open(filename, error)) {
+    return false;
+  }
+  if (rom.Size() == 0) {
+    error = std::string(filename) + " is empty";
+    return false;
+  }
+  if (!LoadROM(rom.Data(), rom.Size())) {
+    error = std::string(filename) + " is " + std::to_string(rom.Size()) +
+            " bytes, more than the " + std::to_string(MAX_ROM_SIZE) +
+            " that fit in memory";
+    return false;
+  }
+  return true;
+}
+
+bool Chip8::LoadROM(uint8_t const *data, size_t size) {
+  if (size == 0 || size > MAX_ROM_SIZE) {
+    return false;
+  }
+
+  memcpy(&memory[START_ADDRESS], data, size);
+
+  InvalidateCode(START_ADDRESS, size);
+  return true;
+}
+
+void Chip8::Seed(uint32_t seed) {
+  // xorshift32 must not start from zero
+  rngState = seed != 0 ? seed : 1;
+}
+
+uint8_t Chip8::RandomByte() {
+  // xorshift32, kept as plain state so it can be saved and restored
+  rngState ^= rngState << 13u;
+  rngState ^= rngState >> 17u;
+  rngState ^= rngState << 5u;
+  return rngState >> 24u;
+}
+
+void Chip8::SaveState(Chip8State &state) const {
+  memcpy(state.memory, memory, sizeof(memory));
+  memcpy(state.display, display, sizeof(display));
+  memcpy(state.stack, stack, sizeof(stack));
+  memcpy(state.registers, registers, sizeof(registers));
+  memcpy(state.flags, flags, sizeof(flags));
+  memcpy(state.audioPattern, audioPattern, sizeof(audioPattern));
+  state.index = index;
+  state.pc = pc;
+  state.sp = sp;
+  state.delayTimer = delayTimer;
+  state.soundTimer = soundTimer;
+  state.hires = hires;
+  state.planes = planes;
+  state.pitch = pitch;
+  state.rngState = rngState;
+  memset(state.padding, 0, sizeof(state.padding));
+}
+
+void Chip8::LoadState(Chip8State const &state) {
+  // Only drop decoded instructions whose memory actually changed. Restoring
+  // a recent state is the common case, so whole pages are compared first.
+  for (unsigned int page = 0; page < MEMORY; page += STATE_PAGE) {
+    if (memcmp(&memory[page], &state.memory[page], STATE_PAGE) == 0) {
+      continue;
+    }
+
+    for (unsigned int i = page; i < page + STATE_PAGE; i += 8) {
+      uint64_t current;
+      uint64_t restored;
+      memcpy(&current, &memory[i], sizeof(current));
+      memcpy(&restored, &state.memory[i], sizeof(restored));
+
+      if (current != restored) {
+        memcpy(&memory[i], &restored, sizeof(restored));
+        InvalidateCode(i, 8);
+      }
+    }
+  }
+
+  if (hires != bool(state.hires)) {
+    hires = state.hires;
+    MarkDirty(0, DISPLAY_Height);
+  }
+
+  for (unsigned int plane = 0; plane < PLANES; ++plane) {
+    for (unsigned int y = 0; y < DISPLAY_Height; ++y) {
+      uint64_t *row = display[plane][y];
+      uint64_t const *restored = state.display[plane][y];
+
+      if (memcmp(row, restored, sizeof(display[plane][y])) != 0) {
+        memcpy(row, restored, sizeof(display[plane][y]));
+        MarkDirty(y, y + 1);
+      }
+    }
+  }
+
+  memcpy(stack, state.stack, sizeof(stack));
+  memcpy(registers, state.registers, sizeof(registers));
+  memcpy(flags, state.flags, sizeof(flags));
+  memcpy(audioPattern, state.audioPattern, sizeof(audioPattern));
+  planes = state.planes;
+  pitch = state.pitch;
+  index = state.index;
+  pc = state.pc;
+  sp = state.sp;
+  delayTimer = state.delayTimer;
+  soundTimer = state.soundTimer;
+  rngState = state.rngState;
+  fault = Fault::None;
+  // States are taken between frames
+  frameLeft = 0;
+  resumed = StopReason::Budget;
+}
+
+uint64_t Chip8::StateHash() const {
+  Chip8State state;
+  SaveState(state);
+  return Hash64(&state, sizeof(state));
+}
+
+uint64_t Chip8::CpuHash() const {
+  struct {
+    uint16_t stack[STACK];
+    uint8_t registers[REGISTERS];
+    uint16_t index;
+    uint16_t pc;
+    uint8_t sp;
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    uint8_t padding;
+  } cpu;
+  static_assert(sizeof(cpu) == 2 * STACK + REGISTERS + 8,
+                "CpuHash must not hash implicit padding");
+
+  memcpy(cpu.stack, stack, sizeof(stack));
+  memcpy(cpu.registers, registers, sizeof(registers));
+  cpu.index = index;
+  cpu.pc = pc;
+  cpu.sp = sp;
+  cpu.delayTimer = delayTimer;
+  cpu.soundTimer = soundTimer;
+  cpu.padding = 0;
+  return Hash64(&cpu, sizeof(cpu));
+}
+
+void Chip8::ClearDirty() {
+  dirtyFirst = DISPLAY_Height;
+  dirtyEnd = 0;
+}
+
+void Chip8::MarkDirty(unsigned int first, unsigned int end) {
+  dirtyFirst = first < dirtyFirst ? first : dirtyFirst;
+  dirtyEnd = end > dirtyEnd ? end : dirtyEnd;
+  if (stopOnDraw) {
+    Stop(StopReason::Draw);
+  }
+}
+
+void ExpandVideo(Display const &display, bool hires, uint32_t *rgba,
+                 unsigned int firstRow, unsigned int rowCount) {
+  // Expand to one RGBA8888 value per pixel, coloured by the planes set
+  unsigned int scale = hires ? 1 : 2;
+
+  for (unsigned int y = firstRow; y < firstRow + rowCount; ++y) {
+    uint64_t words[PLANES][DISPLAY_Words];
+    for (unsigned int plane = 0; plane < PLANES; ++plane) {
+      uint64_t const *row = display[plane][y];
+      words[plane][0] = hires ? row[0] : DoubleBits(row[0] >> 32u);
+      words[plane][1] = hires ? row[1] : DoubleBits(row[0] & 0xFFFFFFFFu);
+    }
+
+    uint32_t *out = &rgba[y * scale * DISPLAY_Width];
+
+    for (unsigned int word = 0; word < DISPLAY_Words; ++word) {
+      uint64_t first = words[0][word];
+      uint64_t second = words[1][word];
+      uint32_t *pixels = &out[word * 64];
+
+#ifdef __SSE2__
+      __m128i const mask = _mm_setr_epi32(8, 4, 2, 1);
+      __m128i const firstOnly = _mm_set1_epi32(PALETTE[1]);
+      __m128i const secondOnly = _mm_set1_epi32(PALETTE[2]);
+      __m128i const both = _mm_set1_epi32(PALETTE[3]);
+
+      for (unsigned int x = 0; x < 64; x += 4) {
+        __m128i bits1 = _mm_set1_epi32((first >> (60u - x)) & 0xFu);
+        __m128i bits2 = _mm_set1_epi32((second >> (60u - x)) & 0xFu);
+        __m128i set1 = _mm_cmpeq_epi32(_mm_and_si128(bits1, mask), mask);
+        __m128i set2 = _mm_cmpeq_epi32(_mm_and_si128(bits2, mask), mask);
+        __m128i only1 = _mm_andnot_si128(set2, set1);
+        __m128i only2 = _mm_andnot_si128(set1, set2);
+        __m128i colour = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(only1, firstOnly),
+                         _mm_and_si128(only2, secondOnly)),
+            _mm_and_si128(_mm_and_si128(set1, set2), both));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pixels[x]), colour);
+      }
+#else
+      for (unsigned int x = 0; x < 64; ++x) {
+        unsigned int planes =
+            ((first >> (63u - x)) & 1u) | ((second >> (63u - x)) & 1u) << 1u;
+        pixels[x] = PALETTE[planes];
+      }
+#endif
+    }
+
+    if (!hires) {
+      memcpy(&out[DISPLAY_Width], out, DISPLAY_Width * sizeof(*out));
+    }
   }
 }
 
 void Chip8::Cycle() {
-  // Fetch
-  opcode = (memory[pc] << 8u) | memory[pc + 1];
+  // Fetch & decode, unless the instruction at this address is already cached
+  Instruction &op = decoded[pc & (CODE_MEMORY - 1u)];
+  if (!op.handler) {
+    Decode(pc & (CODE_MEMORY - 1u));
+  }
+
+#ifdef CHIP8_PROFILE
+  if (sampling) {
+    SampledExecute(op);
+    return;
+  }
+#endif
 
   // Increment the PC before executing
   pc += 2;
 
-  // Decode & Execute
-  ((*this).*(table[(opcode & 0xF000u) >> 12u]))();
+  // Execute
+  op.handler(*this, op);
+}
+
+#ifdef CHIP8_PROFILE
+void Chip8::SetProfiler(Profiler *profiler) {
+  this->profiler = profiler;
+  sampling = 0;
+
+  // Redecode everything so the profiler sees every opcode and the control
+  // flow handlers are swapped in or out
+  memset(decoded, 0, sizeof(decoded));
+  ++codeGeneration;
+}
+
+template <Chip8::Chip8Func F>
+void Chip8::ProfiledInvoke(Chip8 &chip8, Instruction const &op) {
+  uint16_t next = chip8.pc;
+  (chip8.*F)(op);
+
+  if (chip8.pc != next) {
+    unsigned int window = chip8.profiler->Transfer(next - 2u, chip8.pc);
+    if (window) {
+      chip8.sampling = window;
+    }
+  }
+}
+
+Chip8::Handler Chip8::Profiled(Handler handler) {
+  static Handler const wrapped[][2] = {
+      {&Invoke<&Chip8::OP_00EE>, &ProfiledInvoke<&Chip8::OP_00EE>},
+      {&Invoke<&Chip8::OP_00FD>, &ProfiledInvoke<&Chip8::OP_00FD>},
+      {&Invoke<&Chip8::OP_1nnn>, &ProfiledInvoke<&Chip8::OP_1nnn>},
+      {&Invoke<&Chip8::OP_2nnn>, &ProfiledInvoke<&Chip8::OP_2nnn>},
+      {&Invoke<&Chip8::OP_3xkk<false>>,
+       &ProfiledInvoke<&Chip8::OP_3xkk<false>>},
+      {&Invoke<&Chip8::OP_3xkk<true>>, &ProfiledInvoke<&Chip8::OP_3xkk<true>>},
+      {&Invoke<&Chip8::OP_4xkk<false>>,
+       &ProfiledInvoke<&Chip8::OP_4xkk<false>>},
+      {&Invoke<&Chip8::OP_4xkk<true>>, &ProfiledInvoke<&Chip8::OP_4xkk<true>>},
+      {&Invoke<&Chip8::OP_5xy0<false>>,
+       &ProfiledInvoke<&Chip8::OP_5xy0<false>>},
+      {&Invoke<&Chip8::OP_5xy0<true>>, &ProfiledInvoke<&Chip8::OP_5xy0<true>>},
+      {&Invoke<&Chip8::OP_9xy0<false>>,
+       &ProfiledInvoke<&Chip8::OP_9xy0<false>>},
+      {&Invoke<&Chip8::OP_9xy0<true>>, &ProfiledInvoke<&Chip8::OP_9xy0<true>>},
+      {&Invoke<&Chip8::OP_Bnnn<false>>,
+       &ProfiledInvoke<&Chip8::OP_Bnnn<false>>},
+      {&Invoke<&Chip8::OP_Bnnn<true>>, &ProfiledInvoke<&Chip8::OP_Bnnn<true>>},
+      {&Invoke<&Chip8::OP_Ex9E<false>>,
+       &ProfiledInvoke<&Chip8::OP_Ex9E<false>>},
+      {&Invoke<&Chip8::OP_Ex9E<true>>, &ProfiledInvoke<&Chip8::OP_Ex9E<true>>},
+      {&Invoke<&Chip8::OP_ExA1<false>>,
+       &ProfiledInvoke<&Chip8::OP_ExA1<false>>},
+      {&Invoke<&Chip8::OP_ExA1<true>>, &ProfiledInvoke<&Chip8::OP_ExA1<true>>},
+      {&Invoke<&Chip8::OP_F000>, &ProfiledInvoke<&Chip8::OP_F000>},
+      {&Invoke<&Chip8::OP_Fx0A>, &ProfiledInvoke<&Chip8::OP_Fx0A>},
+  };
+
+  for (auto const &entry : wrapped) {
+    if (entry[0] == handler) {
+      return entry[1];
+    }
+  }
+  return handler;
+}
+
+void Chip8::SampledExecute(Instruction const &op) {
+  uint16_t address = pc;
+  // Before executing, as a transfer may start a new window
+  bool timed = --sampling < Profiler::SAMPLE_WINDOW;
+  pc += 2;
+
+  if (!timed) {
+    op.handler(*this, op);
+    return;
+  }
+
+  uint64_t start = Profiler::Ticks();
+  op.handler(*this, op);
+  profiler->AddSample(address, Profiler::Ticks() - start);
+}
+#endif
+
+void Chip8::SetKeypad(uint16_t keys) {
+  for (unsigned int i = 0; i < KEY_COUNT; i++) {
+    keypad[i] = (keys >> i) & 1u;
+  }
+}
+
+void Chip8::TickTimers() {
+  // Called at 60 Hz, independent of the instruction rate
 
   // Decrement the delayTimer if its been set
   if (delayTimer > 0) {
     --delayTimer;
   }
 
+  // The beeper sounds for the frame while the soundTimer runs
+  buzzing = soundTimer > 0;
+
   // Decrement the soundTimer if its been set
   if (soundTimer > 0) {
     --soundTimer;
   }
 }
 
-void Chip8::Table0() { ((*this).*(table0[opcode & 0x000Fu]))(); }
+// Reads the instruction at `address` and its operands, but not its handler
+void Chip8::Fetch(Instruction &op, uint16_t address) const {
+  op.opcode = (memory[address] << 8u) | memory[(address + 1u) & (MEMORY - 1u)];
+  op.nnn = op.opcode & 0x0FFFu;
+  op.x = (op.opcode & 0x0F00u) >> 8u;
+  op.y = (op.opcode & 0x00F0u) >> 4u;
+  op.kk = op.opcode & 0x00FFu;
+  op.n = op.opcode & 0x000Fu;
+
+  // F000 nnnn takes its address from the following word
+  if (op.opcode == 0xF000) {
+    op.nnn = (memory[(address + 2u) & (MEMORY - 1u)] << 8u) |
+             memory[(address + 3u) & (MEMORY - 1u)];
+  }
+}
+
+void Chip8::Decode(uint16_t address) {
+  Instruction &op = decoded[address];
+  Fetch(op, address);
+
+  switch (op.opcode >> 12u) {
+  case 0x0:
+    op.handler = table0[op.kk];
+    break;
+  case 0x5:
+    op.handler = table5[op.n];
+    break;
+  case 0x8:
+    op.handler = table8[op.n];
+    break;
+  case 0xE:
+    op.handler = tableE[op.n];
+    break;
+  case 0xF:
+    op.handler = tableF[op.kk];
+    break;
+  default:
+    op.handler = table[op.opcode >> 12u];
+    break;
+  }
+
+#ifdef CHIP8_PROFILE
+  if (profiler) {
+    profiler->Decoded(address, op.opcode);
+    op.handler = Profiled(op.handler);
+  }
+#endif
+}
+
+void Chip8::InvalidateCode(uint16_t address, size_t length) {
+  // Instructions starting up to three bytes before address also read the
+  // first bytes written, as F000 nnnn is four bytes long
+  for (size_t i = 0; i < length + 3u; i++) {
+    unsigned int start = (address - 3u + i) & (MEMORY - 1u);
+    if (start >= CODE_MEMORY) {
+      continue;
+    }
+    Instruction &op = decoded[start];
+
+    if (op.handler) {
+      op.handler = nullptr;
+      ++codeGeneration;
+    }
+  }
+}
+
+template <bool LongSkip> void Chip8::Skip() {
+  // XO-CHIP skips the whole of a four-byte F000 nnnn
+  uint16_t next = pc & (CODE_MEMORY - 1u);
 
-void Chip8::Table8() { ((*this).*(table8[opcode & 0x000Fu]))(); }
+  if (LongSkip && memory[next] == 0xF0 && memory[next + 1u] == 0x00) {
+    pc += 4;
+  } else {
+    pc += 2;
+  }
+}
 
-void Chip8::TableE() { ((*this).*(tableE[opcode & 0x000Fu]))(); }
+void Chip8::OP_NULL(Instruction const &) { Raise(Fault::InvalidOpcode); }
 
-void Chip8::TableF() { ((*this).*(tableF[opcode & 0x000Fu]))(); }
+void Chip8::OP_00Cn(Instruction const &op) {
+  // Scroll the selected planes down n rows
+  unsigned int rows = hires ? DISPLAY_Height : LORES_Height;
+  unsigned int n = op.n;
 
-void Chip8::OP_NULL() {}
+  for (unsigned int plane = 0; plane < PLANES; ++plane) {
+    if (planes & (1u << plane)) {
+      memmove(display[plane][n], display[plane][0],
+              (rows - n) * sizeof(display[plane][0]));
+      memset(display[plane][0], 0, n * sizeof(display[plane][0]));
+    }
+  }
 
-void Chip8::OP_00E0() {
-  // clear display
-  memset(video, 0, sizeof(video));
+  MarkDirty(0, rows);
 }
 
-void Chip8::OP_00EE() {
+void Chip8::OP_00Dn(Instruction const &op) {
+  // Scroll the selected planes up n rows
+  unsigned int rows = hires ? DISPLAY_Height : LORES_Height;
+  unsigned int n = op.n;
+
+  for (unsigned int plane = 0; plane < PLANES; ++plane) {
+    if (planes & (1u << plane)) {
+      memmove(display[plane][0], display[plane][n],
+              (rows - n) * sizeof(display[plane][0]));
+      memset(display[plane][rows - n], 0, n * sizeof(display[plane][0]));
+    }
+  }
+
+  MarkDirty(0, rows);
+}
+
+void Chip8::OP_00E0(Instruction const &) {
+  // Clear the selected planes
+  unsigned int rows = hires ? DISPLAY_Height : LORES_Height;
+
+  for (unsigned int plane = 0; plane < PLANES; ++plane) {
+    if (planes & (1u << plane)) {
+      memset(display[plane], 0, rows * sizeof(display[plane][0]));
+    }
+  }
+
+  MarkDirty(0, rows);
+}
+
+void Chip8::OP_00EE(Instruction const &) {
   // Return from a subroutine
+  if (sp == 0) {
+    Raise(Fault::StackUnderflow);
+    return;
+  }
   --sp;
   pc = stack[sp];
 }
 
-void Chip8::OP_1nnn() {
+void Chip8::OP_00FB(Instruction const &) {
+  // Scroll the selected planes right 4 pixels
+  unsigned int rows = hires ? DISPLAY_Height : LORES_Height;
+
+  for (unsigned int plane = 0; plane < PLANES; ++plane) {
+    if (!(planes & (1u << plane))) {
+      continue;
+    }
+    for (unsigned int y = 0; y < rows; ++y) {
+      uint64_t *row = display[plane][y];
+      if (hires) {
+        row[1] = (row[1] >> 4u) | (row[0] << 60u);
+      }
+      row[0] >>= 4u;
+    }
+  }
+
+  MarkDirty(0, rows);
+}
+
+void Chip8::OP_00FC(Instruction const &) {
+  // Scroll the selected planes left 4 pixels
+  unsigned int rows = hires ? DISPLAY_Height : LORES_Height;
+
+  for (unsigned int plane = 0; plane < PLANES; ++plane) {
+    if (!(planes & (1u << plane))) {
+      continue;
+    }
+    for (unsigned int y = 0; y < rows; ++y) {
+      uint64_t *row = display[plane][y];
+      row[0] <<= 4u;
+      if (hires) {
+        row[0] |= row[1] >> 60u;
+        row[1] <<= 4u;
+      }
+    }
+  }
+
+  MarkDirty(0, rows);
+}
+
+void Chip8::OP_00FD(Instruction const &) {
+  // Exit the interpreter, by running this instruction forever
+  pc -= 2;
+  cyclesLeft -= FastForward(cyclesLeft);
+}
+
+void Chip8::OP_00FE(Instruction const &) {
+  // Switch to low resolution, clearing the display
+  hires = false;
+  memset(display, 0, sizeof(display));
+
+  MarkDirty(0, DISPLAY_Height);
+}
+
+void Chip8::OP_00FF(Instruction const &) {
+  // Switch to high resolution, clearing the display
+  hires = true;
+  memset(display, 0, sizeof(display));
+
+  MarkDirty(0, DISPLAY_Height);
+}
+
+void Chip8::OP_1nnn(Instruction const &op) {
   // Jump to location nnn
-  uint16_t address = opcode & 0x0FFFu;
+  uint16_t address = op.nnn;
+
+  // A short backward jump may close an idle loop
+  if (address < pc && unsigned(pc - address) <= 2u * IDLE_LOOP_LENGTH) {
+    pc = address;
+    cyclesLeft -= FastForward(cyclesLeft);
+    return;
+  }
 
   pc = address;
 }
 
-void Chip8::OP_2nnn() {
+void Chip8::OP_2nnn(Instruction const &op) {
   // Call subroutine at nnn
-  uint16_t address = opcode & 0x0FFFu;
+  uint16_t address = op.nnn;
 
+  if (sp == STACK) {
+    Raise(Fault::StackOverflow);
+    return;
+  }
   stack[sp] = pc;
   ++sp;
   pc = address;
 }
 
-void Chip8::OP_3xkk() {
+template <bool LongSkip> void Chip8::OP_3xkk(Instruction const &op) {
   // Skip next instructions if Vx = kk
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t byte = opcode & 0x00FFu;
+  uint8_t Vx = op.x;
+  uint8_t byte = op.kk;
 
   if (registers[Vx] == byte) {
-    pc += 2;
+    Skip<LongSkip>();
   }
 }
 
-void Chip8::OP_4xkk() {
+template <bool LongSkip> void Chip8::OP_4xkk(Instruction const &op) {
   // Skip next instructions if Vx != kk
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t byte = opcode & 0x00FFu;
+  uint8_t Vx = op.x;
+  uint8_t byte = op.kk;
 
   if (registers[Vx] != byte) {
-    pc += 2;
+    Skip<LongSkip>();
   }
 }
 
-void Chip8::OP_5xy0() {
+template <bool LongSkip> void Chip8::OP_5xy0(Instruction const &op) {
   // Skip next instructions if Vx= Vy
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
 
   if (registers[Vx] == registers[Vy]) {
-    pc += 2;
+    Skip<LongSkip>();
   }
 }
 
-void Chip8::OP_6xkk() {
+void Chip8::OP_5xy2(Instruction const &op) {
+  // Store Vx to Vy at I, in either order, leaving I unchanged
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
+  unsigned int count = (Vx < Vy ? Vy - Vx : Vx - Vy) + 1u;
+  int step = Vx < Vy ? 1 : -1;
+
+  for (unsigned int i = 0; i < count; ++i) {
+    memory[(index + i) & (MEMORY - 1u)] = registers[Vx + int(i) * step];
+  }
+
+  InvalidateCode(index, count);
+}
+
+void Chip8::OP_5xy3(Instruction const &op) {
+  // Load Vx to Vy from I, in either order, leaving I unchanged
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
+  unsigned int count = (Vx < Vy ? Vy - Vx : Vx - Vy) + 1u;
+  int step = Vx < Vy ? 1 : -1;
+
+  for (unsigned int i = 0; i < count; ++i) {
+    registers[Vx + int(i) * step] = memory[(index + i) & (MEMORY - 1u)];
+  }
+}
+
+void Chip8::OP_6xkk(Instruction const &op) {
   // Set Vx = kk
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t byte = opcode & 0x00FFu;
+  uint8_t Vx = op.x;
+  uint8_t byte = op.kk;
 
   registers[Vx] = byte;
 }
 
-void Chip8::OP_7xkk() {
+void Chip8::OP_7xkk(Instruction const &op) {
   // Set Vx = Vx + kk
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t byte = opcode & 0x00FFu;
+  uint8_t Vx = op.x;
+  uint8_t byte = op.kk;
   registers[Vx] += byte;
 }
 
-void Chip8::OP_8xy0() {
+void Chip8::OP_8xy0(Instruction const &op) {
   // Set Vx = Vy
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
 
   registers[Vx] = registers[Vy];
 }
 
-void Chip8::OP_8xy1() {
+template <bool ResetVF> void Chip8::OP_8xy1(Instruction const &op) {
   // Set Vx = Vx or Vy
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
 
   registers[Vx] |= registers[Vy];
+
+  if (ResetVF) {
+    registers[0xF] = 0;
+  }
 }
 
-void Chip8::OP_8xy2() {
+template <bool ResetVF> void Chip8::OP_8xy2(Instruction const &op) {
   // Set Vx = Vx AND Vy
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
 
   registers[Vx] &= registers[Vy];
+
+  if (ResetVF) {
+    registers[0xF] = 0;
+  }
 }
 
-void Chip8::OP_8xy3() {
+template <bool ResetVF> void Chip8::OP_8xy3(Instruction const &op) {
   // Set Vx = Vx XOR Vy
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
 
   registers[Vx] ^= registers[Vy];
+
+  if (ResetVF) {
+    registers[0xF] = 0;
+  }
 }
 
-void Chip8::OP_8xy4() {
+void Chip8::OP_8xy4(Instruction const &op) {
   // Set Vx = Vx + Vy. Set VF = carry
   // If Sum is greater than 255 (8 bits/1 byte) set VF = 1, else, set VF = 0
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
 
   uint16_t sum = registers[Vx] + registers[Vy];
 
@@ -261,11 +1820,11 @@ void Chip8::OP_8xy4() {
   registers[Vx] = sum & 0xFFu;
 }
 
-void Chip8::OP_8xy5() {
+void Chip8::OP_8xy5(Instruction const &op) {
   // Set Vx = Vx - Vy. Set VF = NOT borrow
   // If Vx > Vy, set VF = 1 else, set VF = 0
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
 
   if (registers[Vx] > registers[Vy]) {
     registers[0xF] = 1;
@@ -275,20 +1834,32 @@ void Chip8::OP_8xy5() {
   registers[Vx] -= registers[Vy];
 }
 
-void Chip8::OP_8xy6() {
-  // Set Vx = Vx SHR 1
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+// The recompiler translates these natively
+template void Chip8::OP_3xkk<false>(Instruction const &op);
+template void Chip8::OP_4xkk<false>(Instruction const &op);
+template void Chip8::OP_5xy0<false>(Instruction const &op);
+template void Chip8::OP_8xy1<false>(Instruction const &op);
+template void Chip8::OP_8xy1<true>(Instruction const &op);
+template void Chip8::OP_8xy2<false>(Instruction const &op);
+template void Chip8::OP_8xy2<true>(Instruction const &op);
+template void Chip8::OP_8xy3<false>(Instruction const &op);
+template void Chip8::OP_8xy3<true>(Instruction const &op);
+
+template <bool ShiftVy> void Chip8::OP_8xy6(Instruction const &op) {
+  // Set Vx = Vx SHR 1, or Vy SHR 1
+  uint8_t Vx = op.x;
+  uint8_t value = registers[ShiftVy ? op.y : op.x];
 
   // Save LSB in VF
-  registers[0xF] = (registers[Vx] & 0x1u);
+  registers[0xF] = (value & 0x1u);
 
-  registers[Vx] >>= 1;
+  registers[Vx] = value >> 1u;
 }
 
-void Chip8::OP_8xy7() {
+void Chip8::OP_8xy7(Instruction const &op) {
   // Set Vx = Vy - Vx, set VF = not borrow
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
 
   if (registers[Vy] > registers[Vx]) {
     registers[0xF] = 1;
@@ -299,104 +1870,183 @@ void Chip8::OP_8xy7() {
   registers[Vx] = registers[Vy] - registers[Vx];
 }
 
-void Chip8::OP_8xyE() {
+template <bool ShiftVy> void Chip8::OP_8xyE(Instruction const &op) {
   // Shift Left
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+  uint8_t Vx = op.x;
+  uint8_t value = registers[ShiftVy ? op.y : op.x];
 
-  registers[0xF] = (registers[Vx] & 0x80u) >> 7u;
+  registers[0xF] = (value & 0x80u) >> 7u;
 
-  registers[Vx] <<= 1;
+  registers[Vx] = value << 1u;
 }
 
-void Chip8::OP_9xy0() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template <bool LongSkip> void Chip8::OP_9xy0(Instruction const &op) {
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
 
   if (registers[Vx] != registers[Vy]) {
-    pc += 2;
+    Skip<LongSkip>();
   }
 }
 
-void Chip8::OP_Annn() {
+template void Chip8::OP_9xy0<false>(Instruction const &op);
+
+void Chip8::OP_Annn(Instruction const &op) {
   // Set I = nnn
-  uint16_t address = opcode & 0x0FFFu;
+  uint16_t address = op.nnn;
 
   index = address;
 }
 
-void Chip8::OP_Bnnn() {
-  // Jump to location nnn + V0
-  uint16_t address = opcode & 0x0FFFu;
+template <bool JumpVx> void Chip8::OP_Bnnn(Instruction const &op) {
+  // Jump to location nnn + V0, or nnn + Vx
+  uint16_t address = op.nnn;
 
-  pc = registers[0] + address;
+  pc = registers[JumpVx ? op.x : 0] + address;
 }
 
-void Chip8::OP_Cxkk() {
+void Chip8::OP_Cxkk(Instruction const &op) {
   // Set Vx = random byte AND kk
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t byte = opcode & 0x00FFu;
+  uint8_t Vx = op.x;
+  uint8_t byte = op.kk;
 
-  registers[Vx] = randByte(randGen) & byte;
+  registers[Vx] = RandomByte() & byte;
 }
 
-void Chip8::OP_Dxyn() {
+template <bool Wrap, bool BigSprites>
+void Chip8::OP_Dxyn(Instruction const &op) {
   // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF =
-  // collision
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-  uint8_t Vy = (opcode & 0x00F0u) >> 4u;
-  uint8_t height = opcode & 0x000Fu;
+  // collision. Dxy0 draws 16x16 sprites where supported, and every selected
+  // plane takes the next sprite's worth of bytes.
+  uint8_t Vx = op.x;
+  uint8_t Vy = op.y;
+  unsigned int width = hires ? DISPLAY_Width : LORES_Width;
+  unsigned int rows = hires ? DISPLAY_Height : LORES_Height;
+
+  unsigned int xPos = registers[Vx] & (width - 1u);
+  unsigned int yPos = registers[Vy] & (rows - 1u);
+  unsigned int height = op.n;
+  unsigned int rowBytes = 1;
+
+  if (BigSprites && height == 0) {
+    height = 16;
+    rowBytes = 2;
+  }
 
-  uint8_t xPos = registers[Vx] % DISPLAY_Width;
-  uint8_t yPos = registers[Vy] % DISPLAY_Height;
+  // Sprites are clipped at the right and bottom edges, unless they wrap
+  unsigned int visible = height;
+  if (!Wrap && visible > rows - yPos) {
+    visible = rows - yPos;
+  }
 
-  registers[0xF] = 0;
+  uint64_t collision = 0;
+  uint16_t address = index;
 
-  for (unsigned int row = 0; row < height; ++row) {
-    uint8_t spriteByte = memory[index + row];
+  for (unsigned int plane = 0; plane < PLANES; ++plane) {
+    if (!(planes & (1u << plane))) {
+      continue;
+    }
 
-    for (unsigned int col = 0; col < 8; ++col) {
-      uint8_t spritePixel = spriteByte & (0x80u >> col);
-      uint32_t *screenPixel =
-          &video[(yPos + row) * DISPLAY_Width + (xPos + col)];
+    for (unsigned int row = 0; row < visible; ++row) {
+      unsigned int source = address + row * rowBytes;
+      // The sprite row, starting at the top bit
+      uint64_t bits = uint64_t(memory[source & (MEMORY - 1u)]) << 56u;
+      if (rowBytes == 2) {
+        bits |= uint64_t(memory[(source + 1u) & (MEMORY - 1u)]) << 48u;
+      }
+      uint64_t *line = display[plane][(yPos + row) & (rows - 1u)];
+
+      if (hires) {
+        uint64_t left = 0;
+        uint64_t right = 0;
+        if (xPos < 64u) {
+          left = bits >> xPos;
+          right = xPos ? bits << (64u - xPos) : 0;
+        } else {
+          right = bits >> (xPos - 64u);
+          if (Wrap && xPos > 64u) {
+            left = bits << (DISPLAY_Width - xPos);
+          }
+        }
 
-      if (spritePixel) {
-        if (*screenPixel == 0xFFFFFFFF) {
-          registers[0xF] = 1;
+        collision |= (line[0] & left) | (line[1] & right);
+        line[0] ^= left;
+        line[1] ^= right;
+      } else {
+        uint64_t spriteRow = bits >> xPos;
+        if (Wrap) {
+          // Low resolution rows are exactly 64 pixels, so wrapping is a
+          // rotate
+          spriteRow |= bits << ((LORES_Width - xPos) & 63u);
         }
-        *screenPixel ^= 0xFFFFFFFF;
+
+        collision |= line[0] & spriteRow;
+        line[0] ^= spriteRow;
       }
     }
+
+    address += height * rowBytes;
+  }
+
+  registers[0xF] = collision != 0;
+
+  if (visible > 0) {
+    if (Wrap && yPos + visible > rows) {
+      // Rows at the top and bottom changed
+      MarkDirty(0, rows);
+    } else {
+      MarkDirty(yPos, yPos + visible);
+    }
   }
 }
 
-void Chip8::OP_Ex9E() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template <bool LongSkip> void Chip8::OP_Ex9E(Instruction const &op) {
+  uint8_t Vx = op.x;
 
-  uint8_t key = registers[Vx];
+  // Only the low nibble names a key
+  uint8_t key = registers[Vx] & 0xFu;
 
   if (keypad[key]) {
-    pc += 2;
+    Skip<LongSkip>();
   }
 }
 
-void Chip8::OP_ExA1() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template <bool LongSkip> void Chip8::OP_ExA1(Instruction const &op) {
+  uint8_t Vx = op.x;
 
-  uint8_t key = registers[Vx];
+  uint8_t key = registers[Vx] & 0xFu;
 
   if (!keypad[key]) {
-    pc += 2;
+    Skip<LongSkip>();
   }
 }
 
-void Chip8::OP_Fx07() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_F000(Instruction const &op) {
+  // Set I = nnnn, the 16-bit address in the next word, and step over it
+  index = op.nnn;
+  pc += 2;
+}
+
+void Chip8::OP_F002(Instruction const &) {
+  // Load the audio pattern from memory starting at I
+  for (unsigned int i = 0; i < AUDIO_PATTERN; ++i) {
+    audioPattern[i] = memory[(index + i) & (MEMORY - 1u)];
+  }
+}
+
+void Chip8::OP_Fn01(Instruction const &op) {
+  // Select the planes later instructions draw to
+  planes = op.x & 0x3u;
+}
+
+void Chip8::OP_Fx07(Instruction const &op) {
+  uint8_t Vx = op.x;
 
   registers[Vx] = delayTimer;
 }
 
-void Chip8::OP_Fx0A() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx0A(Instruction const &op) {
+  uint8_t Vx = op.x;
 
   if (keypad[0]) {
     registers[Vx] = 0;
@@ -432,58 +2082,103 @@ void Chip8::OP_Fx0A() {
     registers[Vx] = 15;
   } else {
     pc -= 2;
+    // Known even when no cycles are left to fast-forward over
+    waiting = Wait::Keypad;
+    cyclesLeft -= FastForward(cyclesLeft);
   }
 }
 
-void Chip8::OP_Fx15() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx15(Instruction const &op) {
+  uint8_t Vx = op.x;
 
   delayTimer = registers[Vx];
 }
 
-void Chip8::OP_Fx18() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx18(Instruction const &op) {
+  uint8_t Vx = op.x;
 
   soundTimer = registers[Vx];
 }
 
-void Chip8::OP_Fx1E() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx1E(Instruction const &op) {
+  uint8_t Vx = op.x;
 
   index += registers[Vx];
 }
 
-void Chip8::OP_Fx29() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx29(Instruction const &op) {
+  uint8_t Vx = op.x;
   uint8_t digit = registers[Vx];
 
   index = FONTSET_START_ADDRESS + (5 * digit);
 }
 
-void Chip8::OP_Fx33() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx30(Instruction const &op) {
+  uint8_t Vx = op.x;
+  uint8_t digit = registers[Vx];
+
+  index = BIG_FONTSET_START_ADDRESS + (10 * digit);
+}
+
+void Chip8::OP_Fx33(Instruction const &op) {
+  uint8_t Vx = op.x;
   uint8_t value = registers[Vx];
 
-  memory[index + 2] = value % 10;
+  memory[(index + 2u) & (MEMORY - 1u)] = value % 10;
   value /= 10;
 
-  memory[index + 1] = value % 10;
+  memory[(index + 1u) & (MEMORY - 1u)] = value % 10;
   value /= 10;
 
   memory[index] = value % 10;
+
+  InvalidateCode(index, 3);
 }
 
-void Chip8::OP_Fx55() {
-  uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx3A(Instruction const &op) {
+  // Set the pitch the audio pattern plays at to Vx
+  pitch = registers[op.x];
+}
+
+template <IndexStep Step> void Chip8::OP_Fx55(Instruction const &op) {
+  uint8_t Vx = op.x;
 
   for (uint8_t i = 0; i <= Vx; ++i) {
-    memory[index + i] = registers[i];
+    memory[(index + i) & (MEMORY - 1u)] = registers[i];
+  }
+
+  InvalidateCode(index, Vx + 1u);
+
+  if (Step != IndexStep::Unchanged) {
+    index += Step == IndexStep::XPlusOne ? Vx + 1u : Vx;
   }
 }
 
-void Chip8::OP_Fx65() {
-  uint8_t Vx = (opcode & 0x0F00U) >> 8U;
+template <IndexStep Step> void Chip8::OP_Fx65(Instruction const &op) {
+  uint8_t Vx = op.x;
   for (uint8_t i = 0; i <= Vx; i++) {
-    registers[i] = memory[index + i];
+    registers[i] = memory[(index + i) & (MEMORY - 1u)];
+  }
+
+  if (Step != IndexStep::Unchanged) {
+    index += Step == IndexStep::XPlusOne ? Vx + 1u : Vx;
+  }
+}
+
+void Chip8::OP_Fx75(Instruction const &op) {
+  // Save V0 to Vx in the flag registers
+  uint8_t Vx = op.x;
+
+  for (uint8_t i = 0; i <= Vx; ++i) {
+    flags[i] = registers[i];
+  }
+}
+
+void Chip8::OP_Fx85(Instruction const &op) {
+  // Restore V0 to Vx from the flag registers
+  uint8_t Vx = op.x;
+
+  for (uint8_t i = 0; i <= Vx; ++i) {
+    registers[i] = flags[i];
   }
 }
@@ -0,0 +1,205 @@
+#include "../headers/chip8_c.h"
+#include "../headers/breakpoints.h"
+#include "../headers/chip8.h"
+#include <cstring>
+#include <memory>
+#include <new>
+
+static_assert(CHIP8_DISPLAY_WIDTH == DISPLAY_Width &&
+                  CHIP8_DISPLAY_HEIGHT == DISPLAY_Height &&
+                  CHIP8_KEY_COUNT == KEY_COUNT,
+              "chip8_c.h is out of step with the core");
+static_assert(CHIP8_STOP_WATCHPOINT == int(StopReason::Watchpoint) &&
+                  CHIP8_FAULT_STACK_UNDERFLOW == int(Fault::StackUnderflow) &&
+                  CHIP8_ACCESS_READ_WRITE ==
+                      int(Breakpoints::Access::ReadWrite),
+              "chip8_c.h enums are out of step with the core");
+
+struct chip8 {
+  explicit chip8(uint32_t seed, Variant variant) : core(seed, variant) {}
+
+  // Attached only while something is set, so the core runs unchecked
+  // otherwise
+  void Attach() {
+    core.SetBreakpoints(breakpoints.Empty() ? nullptr : &breakpoints);
+  }
+
+  Chip8 core;
+  Breakpoints breakpoints;
+};
+
+uint32_t chip8_api_version(void) { return CHIP8_API_VERSION; }
+
+chip8 *chip8_create(uint32_t seed, int variant) {
+  if (variant < CHIP8_VARIANT_COSMAC_VIP || variant > CHIP8_VARIANT_XO_CHIP) {
+    return nullptr;
+  }
+  return new (std::nothrow) chip8(seed, Variant(variant));
+}
+
+void chip8_destroy(chip8 *machine) { delete machine; }
+
+int chip8_load_rom(chip8 *machine, uint8_t const *data, size_t size) {
+  return machine->core.LoadROM(data, size);
+}
+
+int chip8_set_engine(chip8 *machine, int engine) {
+  if (engine != CHIP8_ENGINE_INTERPRETER &&
+      engine != CHIP8_ENGINE_RECOMPILER) {
+    return 0;
+  }
+  machine->core.SetEngine(engine == CHIP8_ENGINE_RECOMPILER
+                              ? Engine::Recompiler
+                              : Engine::Interpreter);
+  return 1;
+}
+
+void chip8_set_keypad(chip8 *machine, uint16_t keys) {
+  machine->core.SetKeypad(keys);
+}
+
+void chip8_set_stop_on_draw(chip8 *machine, int stop) {
+  machine->core.SetStopOnDraw(stop != 0);
+}
+
+void chip8_set_stop_on_fault(chip8 *machine, int stop) {
+  machine->core.SetStopOnFault(stop != 0);
+}
+
+int chip8_run_cycles(chip8 *machine, uint32_t count, uint32_t *left) {
+  StopReason reason = machine->core.RunCycles(count);
+  if (left) {
+    *left = machine->core.CyclesLeft();
+  }
+  return int(reason);
+}
+
+int chip8_run_frame(chip8 *machine, uint32_t instructions, uint32_t *left) {
+  StopReason reason = machine->core.RunFrame(instructions);
+  if (left) {
+    *left = machine->core.CyclesLeft();
+  }
+  return int(reason);
+}
+
+void chip8_tick_timers(chip8 *machine) { machine->core.TickTimers(); }
+
+int chip8_fault(chip8 const *machine, uint16_t *address) {
+  if (address) {
+    *address = machine->core.FaultAddress();
+  }
+  return int(machine->core.Faulted());
+}
+
+void chip8_clear_fault(chip8 *machine) { machine->core.ClearFault(); }
+
+int chip8_hires(chip8 const *machine) { return machine->core.HiRes(); }
+
+int chip8_buzzing(chip8 const *machine) { return machine->core.Buzzing(); }
+
+unsigned int chip8_dirty_rows(chip8 const *machine, unsigned int *first) {
+  if (!machine->core.DisplayDirty()) {
+    return 0;
+  }
+  if (first) {
+    *first = machine->core.DirtyFirstRow();
+  }
+  return machine->core.DirtyRowCount();
+}
+
+void chip8_clear_dirty(chip8 *machine) { machine->core.ClearDirty(); }
+
+void chip8_video(chip8 const *machine, uint32_t *rgba) {
+  bool hires = machine->core.HiRes();
+  ExpandVideo(machine->core.display, hires, rgba, 0,
+              hires ? DISPLAY_Height : LORES_Height);
+}
+
+void chip8_set_breakpoint(chip8 *machine, uint16_t address, int set) {
+  machine->breakpoints.SetBreakpoint(address, set != 0);
+  machine->Attach();
+}
+
+void chip8_set_opcode_breakpoint(chip8 *machine, uint16_t pattern,
+                                 uint16_t mask, int set) {
+  machine->breakpoints.SetOpcodeBreakpoint(pattern, mask, set != 0);
+  machine->Attach();
+}
+
+void chip8_set_watchpoint(chip8 *machine, uint16_t first, uint32_t length,
+                          int access, int set) {
+  if (access < CHIP8_ACCESS_READ || access > CHIP8_ACCESS_READ_WRITE) {
+    return;
+  }
+  machine->breakpoints.SetWatchpoint(first, length,
+                                     Breakpoints::Access(access), set != 0);
+  machine->Attach();
+}
+
+void chip8_clear_breakpoints(chip8 *machine) {
+  machine->breakpoints.Clear();
+  machine->Attach();
+}
+
+int chip8_last_break(chip8 const *machine, uint16_t *pc, uint16_t *address,
+                     int *access) {
+  Breakpoints::Hit const &hit = machine->breakpoints.LastHit();
+  if (pc) {
+    *pc = hit.pc;
+  }
+  if (address) {
+    *address = hit.address;
+  }
+  if (access) {
+    *access = int(hit.access);
+  }
+  return int(hit.reason);
+}
+
+size_t chip8_state_size(void) { return sizeof(Chip8State); }
+
+int chip8_save_state(chip8 const *machine, void *state, size_t size) {
+  if (size != sizeof(Chip8State)) {
+    return 0;
+  }
+  // Caller buffers may not be aligned for a Chip8State, so states are
+  // copied through one owned by the call
+  std::unique_ptr<Chip8State> saved(new (std::nothrow) Chip8State);
+  if (!saved) {
+    return 0;
+  }
+  machine->core.SaveState(*saved);
+  memcpy(state, saved.get(), size);
+  return 1;
+}
+
+int chip8_load_state(chip8 *machine, void const *state, size_t size) {
+  if (size != sizeof(Chip8State)) {
+    return 0;
+  }
+  std::unique_ptr<Chip8State> loaded(new (std::nothrow) Chip8State);
+  if (!loaded) {
+    return 0;
+  }
+  memcpy(loaded.get(), state, size);
+  machine->core.LoadState(*loaded);
+  return 1;
+}
+
+uint64_t chip8_state_hash(chip8 const *machine) {
+  return machine->core.StateHash();
+}
+
+char const *chip8_stop_name(int stop) {
+  if (stop < CHIP8_STOP_BUDGET || stop > CHIP8_STOP_WATCHPOINT) {
+    return "unknown";
+  }
+  return StopReasonName(StopReason(stop));
+}
+
+char const *chip8_fault_name(int fault) {
+  if (fault < CHIP8_FAULT_NONE || fault > CHIP8_FAULT_STACK_UNDERFLOW) {
+    return "unknown";
+  }
+  return FaultName(Fault(fault));
+}
@@ -0,0 +1,132 @@
+#include "../headers/disassembler.h"
+#include <cstdio>
+
+namespace {
+
+std::string Format(char const *format, unsigned int a = 0,
+                   unsigned int b = 0, unsigned int c = 0) {
+  char text[32];
+  std::snprintf(text, sizeof(text), format, a, b, c);
+  return text;
+}
+
+} // namespace
+
+std::string Disassemble(uint16_t opcode) {
+  unsigned int nnn = opcode & 0x0FFFu;
+  unsigned int x = (opcode >> 8u) & 0xFu;
+  unsigned int y = (opcode >> 4u) & 0xFu;
+  unsigned int kk = opcode & 0xFFu;
+  unsigned int n = opcode & 0xFu;
+
+  switch (opcode >> 12u) {
+  case 0x0:
+    if ((kk & 0xF0u) == 0xC0) {
+      return Format("SCD %u", n);
+    } else if ((kk & 0xF0u) == 0xD0) {
+      return Format("SCU %u", n);
+    }
+    switch (kk) {
+    case 0xE0:
+      return "CLS";
+    case 0xEE:
+      return "RET";
+    case 0xFB:
+      return "SCR";
+    case 0xFC:
+      return "SCL";
+    case 0xFD:
+      return "EXIT";
+    case 0xFE:
+      return "LOW";
+    case 0xFF:
+      return "HIGH";
+    }
+    break;
+  case 0x1:
+    return Format("JP 0x%03X", nnn);
+  case 0x2:
+    return Format("CALL 0x%03X", nnn);
+  case 0x3:
+    return Format("SE V%X, 0x%02X", x, kk);
+  case 0x4:
+    return Format("SNE V%X, 0x%02X", x, kk);
+  case 0x5:
+    if (n == 0x2) {
+      return Format("SAVE V%X-V%X", x, y);
+    } else if (n == 0x3) {
+      return Format("LOAD V%X-V%X", x, y);
+    } else if (n == 0x0) {
+      return Format("SE V%X, V%X", x, y);
+    }
+    break;
+  case 0x6:
+    return Format("LD V%X, 0x%02X", x, kk);
+  case 0x7:
+    return Format("ADD V%X, 0x%02X", x, kk);
+  case 0x8: {
+    static char const *const names[16] = {
+        "LD",    "OR",    "AND",   "XOR",   "ADD",   "SUB",   "SHR", "SUBN",
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr};
+    if (names[n]) {
+      return names[n] + Format(" V%X, V%X", x, y);
+    }
+    break;
+  }
+  case 0x9:
+    return Format("SNE V%X, V%X", x, y);
+  case 0xA:
+    return Format("LD I, 0x%03X", nnn);
+  case 0xB:
+    return Format("JP V0, 0x%03X", nnn);
+  case 0xC:
+    return Format("RND V%X, 0x%02X", x, kk);
+  case 0xD:
+    return Format("DRW V%X, V%X, %u", x, y, n);
+  case 0xE:
+    if (n == 0xE) {
+      return Format("SKP V%X", x);
+    } else if (n == 0x1) {
+      return Format("SKNP V%X", x);
+    }
+    break;
+  case 0xF:
+    switch (kk) {
+    case 0x00:
+      // The address is in the next word
+      return "LD I, long";
+    case 0x01:
+      return Format("PLANE %u", x);
+    case 0x02:
+      return "AUDIO";
+    case 0x07:
+      return Format("LD V%X, DT", x);
+    case 0x0A:
+      return Format("LD V%X, K", x);
+    case 0x15:
+      return Format("LD DT, V%X", x);
+    case 0x18:
+      return Format("LD ST, V%X", x);
+    case 0x1E:
+      return Format("ADD I, V%X", x);
+    case 0x29:
+      return Format("LD F, V%X", x);
+    case 0x30:
+      return Format("LD HF, V%X", x);
+    case 0x33:
+      return Format("LD B, V%X", x);
+    case 0x3A:
+      return Format("PITCH V%X", x);
+    case 0x55:
+      return Format("LD [I], V%X", x);
+    case 0x65:
+      return Format("LD V%X, [I]", x);
+    case 0x75:
+      return Format("LD R, V%X", x);
+    case 0x85:
+      return Format("LD V%X, R", x);
+    }
+    break;
+  }
+  return Format("DW 0x%04X", opcode);
+}
@@ -0,0 +1,115 @@
+#include "../headers/emulation_thread.h"
+#include "../headers/scheduler.h"
+#include <cstring>
+
+EmulationThread::EmulationThread(Chip8 &chip8, uint32_t instructionsPerFrame)
+    : chip8(chip8), instructionsPerFrame(instructionsPerFrame) {}
+
+EmulationThread::~EmulationThread() { Stop(); }
+
+void EmulationThread::Start() {
+  running = true;
+  thread = std::thread(&EmulationThread::Run, this);
+}
+
+void EmulationThread::Stop() {
+  running = false;
+
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void EmulationThread::Run() {
+  FrameScheduler scheduler;
+
+  while (running.load(std::memory_order_relaxed)) {
+    unsigned int due = scheduler.FramesDue();
+
+    for (unsigned int i = 0; i < due; ++i) {
+      Step(true);
+    }
+
+    // Turbo fills the rest of the display interval with silent frames
+    bool fast = turbo.load(std::memory_order_relaxed);
+    if (fast) {
+      while (!scheduler.FrameDue() &&
+             running.load(std::memory_order_relaxed)) {
+        Step(false);
+        ++due;
+      }
+    }
+
+    if (due > 0 && runAhead > 0 &&
+        !rewinding.load(std::memory_order_relaxed)) {
+      RunAhead(keys.load(std::memory_order_relaxed));
+    } else if (chip8.DisplayDirty()) {
+      Frame &out = frames.WriteBuffer();
+      memcpy(out.display, chip8.display, sizeof(chip8.display));
+      out.hires = chip8.HiRes();
+      frames.Publish();
+      chip8.ClearDirty();
+    }
+
+    if (!fast) {
+      scheduler.WaitForNextFrame();
+    }
+  }
+}
+
+void EmulationThread::Step(bool audible) {
+  framesRun.fetch_add(1, std::memory_order_relaxed);
+
+  // Snapshots are taken before each frame, so popping one returns to the
+  // start of the frame it was taken at
+  if (rewinding.load(std::memory_order_relaxed)) {
+    if (history.Pop(snapshot)) {
+      chip8.LoadState(snapshot);
+      --frame;
+      if (recording) {
+        recording->Truncate(frame);
+      }
+    }
+    if (beeper && audible) {
+      beeper->Frame(chip8, false);
+    }
+    return;
+  }
+
+  uint16_t held = keys.load(std::memory_order_relaxed);
+  chip8.SaveState(snapshot);
+  history.Push(snapshot);
+  if (recording) {
+    recording->Record(frame, held);
+  }
+
+  chip8.SetKeypad(held);
+  chip8.RunFrame(instructionsPerFrame);
+  ++frame;
+  if (beeper && audible) {
+    beeper->Frame(chip8);
+  }
+}
+
+void EmulationThread::RunAhead(uint16_t held) {
+  // Only the display of the last frame run ahead is kept: no sound, no
+  // recording, and LoadState() undoes the rest
+  chip8.SaveState(present);
+  chip8.SetKeypad(held);
+  for (unsigned int i = 0; i < runAhead; ++i) {
+    chip8.RunFrame(instructionsPerFrame);
+  }
+
+  if (chip8.DisplayDirty()) {
+    Frame &out = frames.WriteBuffer();
+    memcpy(out.display, chip8.display, sizeof(chip8.display));
+    out.hires = chip8.HiRes();
+    frames.Publish();
+    chip8.ClearDirty();
+  }
+
+  // Rows the restore changes stay dirty, so the next frame is published
+  // wherever it differs from this one, even if the guess about the keys
+  // was wrong
+  chip8.LoadState(present);
+}
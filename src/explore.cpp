@@ -0,0 +1,145 @@
+#include "../headers/chip8.h"
+#include "../headers/explorer.h"
+#include "../headers/mapped_file.h"
+#include "../headers/rom_database.h"
+#include "../headers/thread_pool.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// Fault paths printed in full; the rest are only counted
+const size_t SHOWN_FAULTS = 10;
+
+void Usage(char const *program) {
+  std::cerr << "Usage: " << program
+            << " <ROM> [--variant chip8|chip48|schip|xochip]"
+               " [--engine interpreter|recompiler] [--speed N] [--hold N]"
+               " [--states N] [--depth N] [--best-first] [--seed N]"
+               " [--threads N]\n";
+  std::exit(EXIT_FAILURE);
+}
+
+// "- 5 5 A", the key held in each step, '-' for none
+std::string FormatInputs(std::vector<uint8_t> const &keys) {
+  std::string text;
+  for (uint8_t key : keys) {
+    text += text.empty() ? "" : " ";
+    text += key < KEY_COUNT ? "0123456789ABCDEF"[key] : '-';
+  }
+  return text;
+}
+
+} // namespace
+
+// Finds the states a ROM can reach from power-on by holding each key, or
+// none, for a few frames at a time, and reports how many distinct states
+// and screens there are and the inputs that lead to every fault
+int main(int argc, char **argv) {
+  char const *romFilename = nullptr;
+  Explorer::Settings settings;
+  bool variantGiven = false;
+  uint32_t seed = 1;
+  unsigned int threads = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--variant") == 0 && i + 1 < argc) {
+      if (!ParseVariant(argv[++i], settings.variant)) {
+        Usage(argv[0]);
+      }
+      variantGiven = true;
+    } else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      ++i;
+      if (std::strcmp(argv[i], "interpreter") == 0) {
+        settings.engine = Engine::Interpreter;
+      } else if (std::strcmp(argv[i], "recompiler") == 0) {
+        settings.engine = Engine::Recompiler;
+      } else {
+        Usage(argv[0]);
+      }
+    } else if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+      settings.instructionsPerFrame = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--hold") == 0 && i + 1 < argc) {
+      settings.framesPerStep = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--states") == 0 && i + 1 < argc) {
+      settings.maxStates = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+      settings.maxDepth = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--best-first") == 0) {
+      settings.order = Explorer::Order::BestFirst;
+    } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = std::strtoul(argv[++i], nullptr, 10);
+    } else if (argv[i][0] == '-' || romFilename) {
+      Usage(argv[0]);
+    } else {
+      romFilename = argv[i];
+    }
+  }
+
+  if (!romFilename || settings.framesPerStep == 0 ||
+      settings.maxStates == 0 || settings.maxStates > UINT32_MAX) {
+    Usage(argv[0]);
+  }
+
+  std::string error;
+  MappedFile rom;
+  if (!rom.Open(romFilename, error)) {
+    std::cerr << error << "\n";
+    return EXIT_FAILURE;
+  }
+  if (!variantGiven) {
+    settings.variant = DetectVariant(rom.Data(), rom.Size());
+  }
+
+  Chip8 chip8(seed, settings.variant);
+  if (!chip8.LoadROM(rom.Data(), rom.Size())) {
+    std::cerr << romFilename << " is empty or larger than the "
+              << MAX_ROM_SIZE << " bytes that fit in memory\n";
+    return EXIT_FAILURE;
+  }
+
+  Chip8State root;
+  chip8.SaveState(root);
+
+  ThreadPool pool(threads);
+  Explorer explorer(pool, settings);
+
+  auto start = std::chrono::steady_clock::now();
+  explorer.Run(root);
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+
+  std::vector<Explorer::Node> const &nodes = explorer.Nodes();
+  uint32_t depth = 0;
+  for (Explorer::Node const &node : nodes) {
+    depth = node.depth > depth ? node.depth : depth;
+  }
+
+  std::printf("%s, %s: %zu states, %zu screens, %zu faults, %u steps deep\n",
+              romFilename, VariantName(settings.variant), nodes.size(),
+              explorer.Screens(), explorer.Faults().size(), depth);
+  std::printf("%llu states reached again, %.2f s on %u threads "
+              "(%.0f states/s)\n",
+              (unsigned long long)explorer.Duplicates(), seconds, pool.Size(),
+              seconds > 0 ? nodes.size() / seconds : 0.0);
+
+  std::vector<uint32_t> const &faults = explorer.Faults();
+  for (size_t i = 0; i < faults.size() && i < SHOWN_FAULTS; ++i) {
+    Explorer::Node const &node = nodes[faults[i]];
+    std::printf("%s at %03X after %u steps of %u frames: %s\n",
+                FaultName(node.fault), node.faultAddress, node.depth,
+                settings.framesPerStep,
+                FormatInputs(explorer.Inputs(faults[i])).c_str());
+  }
+  if (faults.size() > SHOWN_FAULTS) {
+    std::printf("and %zu more faults\n", faults.size() - SHOWN_FAULTS);
+  }
+  return faults.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
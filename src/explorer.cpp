@@ -0,0 +1,284 @@
+#include "../headers/explorer.h"
+#include "../headers/hash.h"
+#include "../headers/rewind.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+const size_t STATE_BLOCK = 256;
+// Parents expanded per round; enough to keep every worker busy
+const size_t BATCH = 256;
+const unsigned int BRANCHES = KEY_COUNT + 1;
+
+uint8_t const *Bytes(Chip8State const &state) {
+  return reinterpret_cast<uint8_t const *>(&state);
+}
+
+// Seeded with the block's position, so equal blocks in different places
+// do not cancel out
+uint64_t HashBlock(Chip8State const &state, size_t offset) {
+  size_t size = std::min(STATE_BLOCK, sizeof(Chip8State) - offset);
+  return Hash64(Bytes(state) + offset, size, offset);
+}
+
+uint64_t ScreenHash(Chip8State const &state) {
+  return Hash64(state.display, sizeof(Display), state.hires);
+}
+
+} // namespace
+
+TranspositionTable::TranspositionTable(size_t capacity) {
+  size = 1;
+  while (size < capacity) {
+    size <<= 1u;
+  }
+  slots = std::make_unique<std::atomic<uint64_t>[]>(size);
+  Clear();
+}
+
+void TranspositionTable::Clear() {
+  for (size_t i = 0; i < size; ++i) {
+    slots[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+bool TranspositionTable::Contains(uint64_t hash) const {
+  hash = hash ? hash : 1;
+
+  for (size_t probe = 0; probe < size; ++probe) {
+    uint64_t found =
+        slots[(hash + probe) & (size - 1u)].load(std::memory_order_relaxed);
+    if (found == hash) {
+      return true;
+    }
+    if (found == 0) {
+      return false;
+    }
+  }
+  return false;
+}
+
+bool TranspositionTable::Insert(uint64_t hash) {
+  hash = hash ? hash : 1;
+
+  for (size_t probe = 0; probe < size; ++probe) {
+    std::atomic<uint64_t> &slot = slots[(hash + probe) & (size - 1u)];
+    uint64_t found = slot.load(std::memory_order_relaxed);
+    if (found == 0 &&
+        slot.compare_exchange_strong(found, hash, std::memory_order_relaxed)) {
+      return true;
+    }
+    // Either someone else claimed the slot first or it was already taken
+    if (found == hash) {
+      return false;
+    }
+  }
+  return false;
+}
+
+uint64_t BlockHash(Chip8State const &state) {
+  uint64_t hash = 0;
+  for (size_t offset = 0; offset < sizeof(Chip8State); offset += STATE_BLOCK) {
+    hash ^= HashBlock(state, offset);
+  }
+  return hash;
+}
+
+uint64_t UpdateBlockHash(uint64_t hash, Chip8State const &from,
+                         Chip8State const &to) {
+  for (size_t offset = 0; offset < sizeof(Chip8State); offset += STATE_BLOCK) {
+    size_t size = std::min(STATE_BLOCK, sizeof(Chip8State) - offset);
+    if (memcmp(Bytes(from) + offset, Bytes(to) + offset, size) != 0) {
+      hash ^= HashBlock(from, offset) ^ HashBlock(to, offset);
+    }
+  }
+  return hash;
+}
+
+// What one input did to one parent
+struct Explorer::Child {
+  uint64_t hash;
+  uint64_t screen;
+  Fault fault;
+  uint16_t faultAddress;
+  // Reached in an earlier round, so not encoded
+  bool known;
+  std::vector<uint8_t> encoded;
+};
+
+// A machine and state buffers for one worker, reused across rounds
+struct Explorer::Scratch {
+  explicit Scratch(Settings const &settings) : chip8(0, settings.variant) {
+    chip8.SetEngine(settings.engine);
+    encoded.resize(RewindBuffer::MaxEncodedSize(sizeof(Chip8State)));
+  }
+
+  Chip8 chip8;
+  Chip8State parent;
+  Chip8State child;
+  std::vector<uint8_t> encoded;
+};
+
+// The tables have room for every node and a whole round of children,
+// kept at most half full so probes stay short
+Explorer::Explorer(ThreadPool &pool, Settings const &settings)
+    : pool(pool), settings(settings),
+      states((settings.maxStates + BATCH * BRANCHES) * 2),
+      screens((settings.maxStates + BATCH * BRANCHES) * 2),
+      root(std::make_unique<Chip8State>()) {}
+
+Explorer::~Explorer() = default;
+
+void Explorer::Run(Chip8State const &root) {
+  *this->root = root;
+  states.Clear();
+  screens.Clear();
+  nodes.clear();
+  arena.clear();
+  faults.clear();
+  frontier.clear();
+  screenCount = 0;
+  duplicates = 0;
+
+  uint64_t hash = BlockHash(root);
+  states.Insert(hash);
+  screens.Insert(ScreenHash(root));
+  Add({0, 0, KEY_COUNT, Fault::None, 0, 0, 0, hash}, {}, true);
+
+  std::vector<uint32_t> batch;
+  std::vector<Child> children;
+  auto later = [this](Entry const &a, Entry const &b) { return Later(a, b); };
+
+  while (!frontier.empty() && nodes.size() < settings.maxStates) {
+    batch.clear();
+    while (!frontier.empty() && batch.size() < BATCH) {
+      std::pop_heap(frontier.begin(), frontier.end(), later);
+      batch.push_back(frontier.back().node);
+      frontier.pop_back();
+    }
+
+    children.resize(batch.size() * BRANCHES);
+    pool.ParallelFor(batch.size(), [&](size_t begin, size_t end) {
+      Expand(batch, children, begin, end);
+    });
+
+    // Inserted here in child order rather than by the workers, so which
+    // of two paths to a state is kept does not depend on thread timing
+    for (size_t i = 0; i < children.size(); ++i) {
+      Child const &child = children[i];
+      if (nodes.size() == settings.maxStates) {
+        break;
+      }
+      if (child.known || !states.Insert(child.hash)) {
+        ++duplicates;
+        continue;
+      }
+
+      Node const &parent = nodes[batch[i / BRANCHES]];
+      Add({batch[i / BRANCHES], parent.depth + 1, uint8_t(i % BRANCHES),
+           child.fault, child.faultAddress, 0, 0, child.hash},
+          child.encoded, screens.Insert(child.screen));
+    }
+  }
+}
+
+void Explorer::Expand(std::vector<uint32_t> const &batch,
+                      std::vector<Child> &children, size_t begin,
+                      size_t end) {
+  std::unique_ptr<Scratch> scratch;
+  {
+    std::lock_guard<std::mutex> lock(spareMutex);
+    if (!spare.empty()) {
+      scratch = std::move(spare.back());
+      spare.pop_back();
+    }
+  }
+  if (!scratch) {
+    scratch = std::make_unique<Scratch>(settings);
+  }
+
+  Chip8 &chip8 = scratch->chip8;
+  for (size_t i = begin; i < end; ++i) {
+    State(batch[i], scratch->parent);
+    uint64_t parentHash = nodes[batch[i]].hash;
+
+    for (unsigned int key = 0; key < BRANCHES; ++key) {
+      chip8.LoadState(scratch->parent);
+      chip8.SetKeypad(key < KEY_COUNT ? 1u << key : 0);
+      for (uint32_t frame = 0; frame < settings.framesPerStep &&
+                               chip8.Faulted() == Fault::None;
+           ++frame) {
+        chip8.RunFrame(settings.instructionsPerFrame);
+      }
+      chip8.SaveState(scratch->child);
+
+      Child &child = children[i * BRANCHES + key];
+      child.hash = UpdateBlockHash(parentHash, scratch->parent, scratch->child);
+      child.fault = chip8.Faulted();
+      child.faultAddress = chip8.FaultAddress();
+      // The tables only change between rounds
+      child.known = states.Contains(child.hash);
+      if (child.known) {
+        continue;
+      }
+
+      child.screen = ScreenHash(scratch->child);
+      size_t size =
+          RewindBuffer::Encode(Bytes(scratch->child), Bytes(*root),
+                               sizeof(Chip8State), scratch->encoded.data());
+      child.encoded.assign(scratch->encoded.begin(),
+                           scratch->encoded.begin() + size);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(spareMutex);
+  spare.push_back(std::move(scratch));
+}
+
+void Explorer::Add(Node node, std::vector<uint8_t> const &encoded,
+                   bool newScreen) {
+  node.offset = arena.size();
+  node.size = encoded.size();
+  arena.insert(arena.end(), encoded.begin(), encoded.end());
+
+  uint32_t index = nodes.size();
+  nodes.push_back(node);
+  screenCount += newScreen;
+
+  if (node.fault != Fault::None) {
+    faults.push_back(index);
+  } else if (node.depth < settings.maxDepth) {
+    frontier.push_back({newScreen, index});
+    std::push_heap(frontier.begin(), frontier.end(),
+                   [this](Entry const &a, Entry const &b) {
+                     return Later(a, b);
+                   });
+  }
+}
+
+// Heap order: true when `a` is to be expanded after `b`
+bool Explorer::Later(Entry const &a, Entry const &b) const {
+  if (settings.order == Order::BestFirst && a.newScreen != b.newScreen) {
+    return b.newScreen;
+  }
+  uint32_t depthA = nodes[a.node].depth;
+  uint32_t depthB = nodes[b.node].depth;
+  return depthA != depthB ? depthA > depthB : a.node > b.node;
+}
+
+std::vector<uint8_t> Explorer::Inputs(uint32_t node) const {
+  std::vector<uint8_t> keys;
+  for (; node != 0; node = nodes[node].parent) {
+    keys.push_back(nodes[node].key);
+  }
+  std::reverse(keys.begin(), keys.end());
+  return keys;
+}
+
+void Explorer::State(uint32_t node, Chip8State &state) const {
+  state = *root;
+  RewindBuffer::Decode(arena.data() + nodes[node].offset, nodes[node].size,
+                       reinterpret_cast<uint8_t *>(&state));
+}
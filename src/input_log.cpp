@@ -0,0 +1,104 @@
+#include "../headers/input_log.h"
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+char const MAGIC[4] = {'C', '8', 'I', 'L'};
+const uint32_t VERSION = 2;
+
+template <typename T> void Write(std::ofstream &file, T value) {
+  file.write(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+template <typename T> bool Read(std::ifstream &file, T &value) {
+  return bool(file.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+} // namespace
+
+InputLog::InputLog(uint32_t seed, Variant variant,
+                   uint32_t instructionsPerFrame, uint64_t initialHash)
+    : seed(seed), variant(variant), instructionsPerFrame(instructionsPerFrame),
+      initialHash(initialHash) {}
+
+void InputLog::Record(uint32_t frame, uint16_t keys) {
+  uint16_t held = events.empty() ? 0 : events.back().keys;
+  if (keys != held) {
+    events.push_back({frame, keys});
+  }
+  frameCount = frame + 1;
+}
+
+void InputLog::Truncate(uint32_t frame) {
+  while (!events.empty() && events.back().frame >= frame) {
+    events.pop_back();
+  }
+  if (frameCount > frame) {
+    frameCount = frame;
+  }
+  cursor = 0;
+}
+
+uint16_t InputLog::KeysAt(uint32_t frame) {
+  if (cursor > 0 && events[cursor - 1].frame > frame) {
+    cursor = 0;
+  }
+  while (cursor < events.size() && events[cursor].frame <= frame) {
+    ++cursor;
+  }
+  return cursor > 0 ? events[cursor - 1].keys : 0;
+}
+
+// Little-endian: magic, version, seed, variant, instructions per frame,
+// initial hash, frame count, event count, then (frame, keys) pairs
+bool InputLog::Save(char const *filename) const {
+  std::ofstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  file.write(MAGIC, sizeof(MAGIC));
+  Write(file, VERSION);
+  Write(file, seed);
+  Write(file, uint32_t(variant));
+  Write(file, instructionsPerFrame);
+  Write(file, initialHash);
+  Write(file, frameCount);
+  Write(file, uint32_t(events.size()));
+  for (InputEvent const &event : events) {
+    Write(file, event.frame);
+    Write(file, event.keys);
+  }
+  return bool(file);
+}
+
+bool InputLog::Load(char const *filename) {
+  std::ifstream file(filename, std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  uint32_t version;
+  uint32_t variantId;
+  uint32_t count;
+
+  if (!file.read(magic, sizeof(magic)) ||
+      memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      !Read(file, version) || version != VERSION || !Read(file, seed) ||
+      !Read(file, variantId) || variantId > uint32_t(Variant::XoChip) ||
+      !Read(file, instructionsPerFrame) || !Read(file, initialHash) ||
+      !Read(file, frameCount) || !Read(file, count)) {
+    return false;
+  }
+
+  variant = Variant(variantId);
+
+  events.clear();
+  cursor = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    InputEvent event;
+    if (!Read(file, event.frame) || !Read(file, event.keys)) {
+      return false;
+    }
+    events.push_back(event);
+  }
+  return true;
+}
@@ -1,45 +1,283 @@
+#include "../headers/audio_output.h"
+#include "../headers/beeper.h"
 #include "../headers/chip8.h"
+#include "../headers/emulation_thread.h"
+#include "../headers/input_log.h"
+#include "../headers/mapped_file.h"
 #include "../headers/platform.h"
+#ifdef CHIP8_PROFILE
+#include "../headers/profiler.h"
+#endif
+#include "../headers/rom_database.h"
+#include "../headers/scheduler.h"
+#include "../headers/trace_log.h"
 #include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
+
+namespace {
+
+// Used when neither the command line nor the ROM database sets a speed
+const int DEFAULT_INSTRUCTIONS_PER_FRAME = 15;
+const unsigned int DEFAULT_AUDIO_BUFFER_MS = 20;
+char const *const TITLE = "CHIP-8 Emulator";
+
+void Usage(char const *program) {
+  std::cerr << "Usage: " << program
+            << " <Scale> <InstructionsPerFrame> <ROM>"
+               " [--engine interpreter|recompiler]"
+               " [--variant chip8|chip48|schip|xochip] [--seed N]"
+               " [--record FILE] [--db FILE] [--audio-buffer MS]"
+               " [--run-ahead FRAMES] [--turbo] [--trace FILE]\n"
+               "An InstructionsPerFrame of 0 takes it from the ROM"
+               " database\n";
+  std::exit(EXIT_FAILURE);
+}
+
+} // namespace
 
 int main(int argc, char **argv) {
-  if (argc != 4) {
-    std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
-    std::exit(EXIT_FAILURE);
+  if (argc < 4) {
+    Usage(argv[0]);
   }
 
   int videoScale = std::stoi(argv[1]);
-  int cycleDelay = std::stoi(argv[2]);
+  int instructionsPerFrame = std::stoi(argv[2]);
 
   char const *romFilename = argv[3];
 
-  Platform platform("CHIP-8 Emulator", DISPLAY_Width * videoScale,
-                    DISPLAY_Height * videoScale, DISPLAY_Width, DISPLAY_Height);
+  Engine engine = Engine::Interpreter;
+  Variant variant = Variant::CosmacVip;
+  bool variantGiven = false;
+  uint32_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+  char const *recordFilename = nullptr;
+  char const *databaseFilename = nullptr;
+  unsigned int audioBuffer = DEFAULT_AUDIO_BUFFER_MS;
+  unsigned int runAhead = 0;
+  bool turbo = false;
+  char const *traceFilename = nullptr;
+
+  for (int i = 4; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      ++i;
+      if (std::strcmp(argv[i], "interpreter") == 0) {
+        engine = Engine::Interpreter;
+      } else if (std::strcmp(argv[i], "recompiler") == 0) {
+        engine = Engine::Recompiler;
+      } else {
+        Usage(argv[0]);
+      }
+    } else if (std::strcmp(argv[i], "--variant") == 0 && i + 1 < argc) {
+      if (!ParseVariant(argv[++i], variant)) {
+        std::cerr << "Unknown variant " << argv[i] << "\n";
+        std::exit(EXIT_FAILURE);
+      }
+      variantGiven = true;
+    } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = std::stoul(argv[++i]);
+    } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      recordFilename = argv[++i];
+    } else if (std::strcmp(argv[i], "--db") == 0 && i + 1 < argc) {
+      databaseFilename = argv[++i];
+    } else if (std::strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc) {
+      audioBuffer = std::stoul(argv[++i]);
+    } else if (std::strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc) {
+      runAhead = std::stoul(argv[++i]);
+    } else if (std::strcmp(argv[i], "--turbo") == 0) {
+      turbo = true;
+    } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      traceFilename = argv[++i];
+    } else {
+      Usage(argv[0]);
+    }
+  }
+
+  std::string error;
+  MappedFile rom;
+  if (!rom.Open(romFilename, error)) {
+    std::cerr << error << "\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  // Settings from the command line win over the database, and the
+  // database over guessing
+  RomSettings settings;
+  bool known = false;
+  if (databaseFilename) {
+    RomDatabase database;
+    if (!database.Open(databaseFilename, error)) {
+      std::cerr << error << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+    known = database.Find(RomHash(rom.Data(), rom.Size()), settings);
+  }
+  if (!known) {
+    settings.variant = DetectVariant(rom.Data(), rom.Size());
+  }
+  if (!variantGiven) {
+    variant = settings.variant;
+  }
+  if (instructionsPerFrame <= 0) {
+    instructionsPerFrame = settings.instructionsPerFrame
+                               ? settings.instructionsPerFrame
+                               : DEFAULT_INSTRUCTIONS_PER_FRAME;
+  }
+
+  // The scale is relative to the original 64x32 display
+  Platform platform(TITLE, LORES_Width * videoScale,
+                    LORES_Height * videoScale, DISPLAY_Width, DISPLAY_Height);
+
+  Chip8 chip8(seed, variant);
+  chip8.SetEngine(engine);
+  if (!chip8.LoadROM(rom.Data(), rom.Size())) {
+    std::cerr << romFilename << " is empty or larger than the "
+              << MAX_ROM_SIZE << " bytes that fit in memory\n";
+    std::exit(EXIT_FAILURE);
+  }
+  rom.Close();
+
+  InputLog log(seed, variant, instructionsPerFrame, chip8.StateHash());
+
+  // Frames run ahead are thrown away, so they would only confuse a trace
+  TraceWriter tracer;
+  if (traceFilename) {
+    if (!tracer.Open(traceFilename, variant, error)) {
+      std::cerr << error << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+    chip8.SetTracer(&tracer);
+    runAhead = 0;
+  }
 
-  Chip8 chip8;
-  chip8.LoadROM(romFilename);
+#ifdef CHIP8_PROFILE
+  Profiler profiler;
+  chip8.SetProfiler(&profiler);
+  platform.ShowProfiler(&profiler);
+#endif
 
-  int videoPitch = sizeof(chip8.video[0]) * DISPLAY_Width;
+  // The emulator owns chip8 from here on, this thread only renders
+  EmulationThread emulation(chip8, instructionsPerFrame);
+  if (recordFilename) {
+    emulation.SetRecording(&log);
+  }
+  emulation.SetRunAhead(runAhead);
 
-  auto lastCycleTime = std::chrono::high_resolution_clock::now();
+  // Without an audio device the emulator just runs silent
+  AudioOutput audio;
+  std::unique_ptr<Beeper> beeper;
+  if (audio.Open(audioBuffer, error)) {
+    beeper = std::make_unique<Beeper>(audio.Ring(), audio.SampleRate());
+    emulation.SetAudio(beeper.get());
+  } else {
+    std::cerr << error << "\n";
+  }
+  emulation.Start();
+
+  uint8_t keys[KEY_COUNT]{};
+  Display shown{};
+  bool shownHiRes = false;
+  bool firstFrame = true;
+  uint32_t video[DISPLAY_Width * DISPLAY_Height]{};
+  int videoPitch = sizeof(video[0]) * DISPLAY_Width;
+
+  FrameScheduler refresh;
   bool quit = false;
 
+  // In turbo the title shows the speed, measured about once a second
+  platform.SetTurbo(turbo);
+  bool shownTurbo = false;
+  auto speedStart = std::chrono::steady_clock::now();
+  uint64_t speedFrames = 0;
+
   while (!quit) {
-    quit = platform.ProcessInput(chip8.keypad);
+    quit = platform.ProcessInput(keys);
 
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(
-                   currentTime - lastCycleTime)
-                   .count();
+    uint16_t keyMask = 0;
+    for (unsigned int i = 0; i < KEY_COUNT; ++i) {
+      keyMask |= keys[settings.keymap[i]] << i;
+    }
+    emulation.SetKeys(keyMask);
+    emulation.SetRewinding(platform.RewindHeld());
+    emulation.SetTurbo(platform.Turbo());
 
-    if (dt > cycleDelay) {
-      lastCycleTime = currentTime;
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - speedStart).count();
+    if (platform.Turbo() != shownTurbo || elapsed >= 1.0) {
+      uint64_t frames = emulation.FramesRun();
+      if (platform.Turbo()) {
+        std::string title = std::string(TITLE) + " - turbo";
+        if (shownTurbo) {
+          char speed[32];
+          std::snprintf(speed, sizeof(speed), " %.1fx",
+                        (frames - speedFrames) / elapsed / 60.0);
+          title += speed;
+        }
+        platform.SetTitle(title.c_str());
+      } else if (shownTurbo) {
+        platform.SetTitle(TITLE);
+      }
+      shownTurbo = platform.Turbo();
+      speedStart = now;
+      speedFrames = frames;
+    }
+
+    if (emulation.Frames().Update()) {
+      Frame const &frame = emulation.Frames().ReadBuffer();
+
+      // Frames may have been skipped, so diff against what is on screen
+      bool redraw = firstFrame || frame.hires != shownHiRes;
+      unsigned int rows = frame.hires ? DISPLAY_Height : LORES_Height;
+      unsigned int first = rows;
+      unsigned int end = 0;
+      for (unsigned int y = 0; y < rows; ++y) {
+        bool changed = redraw;
+        for (unsigned int plane = 0; plane < PLANES; ++plane) {
+          changed |= memcmp(frame.display[plane][y], shown[plane][y],
+                            sizeof(shown[plane][y])) != 0;
+        }
+        if (changed) {
+          first = y < first ? y : first;
+          end = y + 1;
+        }
+      }
 
-      chip8.Cycle();
+      if (first < end) {
+        // Low resolution rows cover two rows of the texture
+        unsigned int scale = frame.hires ? 1 : 2;
+        unsigned int count = end - first;
 
-      platform.Update(chip8.video, videoPitch);
+        ExpandVideo(frame.display, frame.hires, video, first, count);
+        platform.Update(&video[first * scale * DISPLAY_Width], videoPitch,
+                        first * scale, count * scale);
+        memcpy(shown, frame.display, sizeof(shown));
+        shownHiRes = frame.hires;
+        firstFrame = false;
+      }
     }
+
+    platform.Present();
+    refresh.FramesDue();
+    refresh.WaitForNextFrame();
+  }
+
+  emulation.Stop();
+  audio.Close();
+
+  if (audio.Underruns() > 0) {
+    std::cerr << audio.Underruns() << " audio underruns, consider a larger"
+              << " --audio-buffer\n";
+  }
+
+  if (recordFilename && !log.Save(recordFilename)) {
+    std::cerr << "Could not write " << recordFilename << "\n";
+    return EXIT_FAILURE;
+  }
+  if (traceFilename && !tracer.Close()) {
+    std::cerr << "Could not write " << traceFilename << "\n";
+    return EXIT_FAILURE;
   }
   return 0;
 }
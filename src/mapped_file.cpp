@@ -0,0 +1,89 @@
+#include "../headers/mapped_file.h"
+#include <cerrno>
+#include <cstring>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+MappedFile::~MappedFile() { Close(); }
+
+#ifdef __unix__
+bool MappedFile::Open(char const *filename, std::string &error) {
+  Close();
+
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    error = std::string("cannot open ") + filename + ": " + strerror(errno);
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    error = std::string(filename) + " is not a regular file";
+    close(fd);
+    return false;
+  }
+
+  // Mapping zero bytes fails, an empty file is just an empty view
+  if (info.st_size > 0) {
+    void *view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED) {
+      error = std::string("cannot map ") + filename + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+    data = static_cast<uint8_t const *>(view);
+    size = info.st_size;
+    mapped = true;
+  }
+
+  // The mapping stays valid once the descriptor is closed
+  close(fd);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (mapped) {
+    munmap(const_cast<uint8_t *>(data), size);
+  }
+  data = nullptr;
+  size = 0;
+  mapped = false;
+  buffer.clear();
+}
+#else
+bool MappedFile::Open(char const *filename, std::string &error) {
+  Close();
+
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    error = std::string("cannot open ") + filename;
+    return false;
+  }
+
+  buffer.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+  if (file.bad()) {
+    error = std::string("cannot read ") + filename;
+    buffer.clear();
+    return false;
+  }
+
+  data = buffer.data();
+  size = buffer.size();
+  return true;
+}
+
+void MappedFile::Close() {
+  data = nullptr;
+  size = 0;
+  buffer.clear();
+}
+#endif
@@ -0,0 +1,192 @@
+#include "../headers/overlay.h"
+#include "../headers/profiler.h"
+#include "imgui.h"
+#include "imgui_impl_sdl2.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+const size_t HOT_LOOPS = 8;
+const unsigned int HEATMAP_COLUMNS = 64;
+const float HEATMAP_CELL = 4.0f;
+
+} // namespace
+
+Overlay::Overlay(SDL_Window *window, SDL_Renderer *renderer)
+    : renderer(renderer) {
+  IMGUI_CHECKVERSION();
+  ImGui::CreateContext();
+  ImGui::GetIO().IniFilename = nullptr;
+  ImGui::StyleColorsDark();
+  ImGui_ImplSDL2_InitForSDLRenderer(window, renderer);
+
+  unsigned char *pixels;
+  int width;
+  int height;
+  ImGui::GetIO().Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+  fontTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888,
+                                  SDL_TEXTUREACCESS_STATIC, width, height);
+  SDL_UpdateTexture(fontTexture, nullptr, pixels, width * 4);
+  SDL_SetTextureBlendMode(fontTexture, SDL_BLENDMODE_BLEND);
+  ImGui::GetIO().Fonts->SetTexID(fontTexture);
+}
+
+Overlay::~Overlay() {
+  ImGui_ImplSDL2_Shutdown();
+  ImGui::DestroyContext();
+  SDL_DestroyTexture(fontTexture);
+}
+
+void Overlay::ProcessEvent(SDL_Event const &event) {
+  if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F1) {
+    visible = !visible;
+  }
+  ImGui_ImplSDL2_ProcessEvent(&event);
+}
+
+void Overlay::Draw(Profiler const &profiler) {
+  ImGui_ImplSDL2_NewFrame();
+  ImGui::NewFrame();
+
+  ImGui::SetNextWindowPos(ImVec2(8, 8), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowBgAlpha(0.85f);
+  ImGui::Begin("Profiler");
+
+  uint64_t instructions = profiler.Instructions();
+  ImGui::Text("%llu instructions", (unsigned long long)instructions);
+
+  if (ImGui::CollapsingHeader("Opcodes", ImGuiTreeNodeFlags_DefaultOpen) &&
+      ImGui::BeginTable("opcodes", 4,
+                        ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY,
+                        ImVec2(0, 200))) {
+    std::vector<Profiler::OpcodeStats> opcodes = profiler.Opcodes();
+    uint64_t totalTicks = 0;
+    for (Profiler::OpcodeStats const &stats : opcodes) {
+      totalTicks += stats.ticks;
+    }
+
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Opcode");
+    ImGui::TableSetupColumn("Count");
+    ImGui::TableSetupColumn("Ticks/op");
+    ImGui::TableSetupColumn("Time %");
+    ImGui::TableHeadersRow();
+
+    for (Profiler::OpcodeStats const &stats : opcodes) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(stats.mnemonic);
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)stats.count);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.1f", double(stats.ticks) / stats.count);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.1f", totalTicks ? 100.0 * stats.ticks / totalTicks : 0.0);
+    }
+    ImGui::EndTable();
+  }
+
+  if (ImGui::CollapsingHeader("Hot loops", ImGuiTreeNodeFlags_DefaultOpen)) {
+    for (Profiler::Loop const &loop : profiler.HotLoops(HOT_LOOPS)) {
+      ImGui::Text("%03X-%03X  %5.1f%%  %llu iterations, %.1f instr/iter",
+                  loop.start, loop.end,
+                  instructions ? 100.0 * loop.instructions / instructions : 0.0,
+                  (unsigned long long)loop.iterations,
+                  double(loop.instructions) / loop.iterations);
+    }
+  }
+
+  if (ImGui::CollapsingHeader("PC heatmap", ImGuiTreeNodeFlags_DefaultOpen)) {
+    // One cell per address, brightness on a log scale of the hit count
+    std::vector<uint64_t> hits = profiler.Hits();
+    uint64_t maxHits = 1;
+    for (uint64_t count : hits) {
+      maxHits = count > maxHits ? count : maxHits;
+    }
+    float scale = 1.0f / std::log1p(float(maxHits));
+
+    ImDrawList *drawList = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    for (unsigned int address = 0; address < CODE_MEMORY; ++address) {
+      if (hits[address] == 0) {
+        continue;
+      }
+      float heat = std::log1p(float(hits[address])) * scale;
+      ImVec2 min(origin.x + (address % HEATMAP_COLUMNS) * HEATMAP_CELL,
+                 origin.y + (address / HEATMAP_COLUMNS) * HEATMAP_CELL);
+      ImVec2 max(min.x + HEATMAP_CELL, min.y + HEATMAP_CELL);
+      drawList->AddRectFilled(min, max,
+                              ImColor(heat, heat * 0.5f, 1.0f - heat));
+    }
+
+    ImVec2 size(HEATMAP_COLUMNS * HEATMAP_CELL,
+                CODE_MEMORY / HEATMAP_COLUMNS * HEATMAP_CELL);
+    ImGui::InvisibleButton("heatmap", size);
+    if (ImGui::IsItemHovered()) {
+      ImVec2 mouse = ImGui::GetIO().MousePos;
+      unsigned int column = (mouse.x - origin.x) / HEATMAP_CELL;
+      unsigned int row = (mouse.y - origin.y) / HEATMAP_CELL;
+      unsigned int address = row * HEATMAP_COLUMNS + column;
+      if (address < CODE_MEMORY) {
+        ImGui::SetTooltip("%03X: %llu", address,
+                          (unsigned long long)hits[address]);
+      }
+    }
+  }
+
+  ImGui::End();
+  ImGui::Render();
+  Render(ImGui::GetDrawData());
+}
+
+// Minimal SDL_Renderer backend, the vendored copy of Dear ImGui only has
+// the SDL2 platform half
+void Overlay::Render(ImDrawData const *data) {
+  SDL_Rect previousClip;
+  SDL_bool clipped = SDL_RenderIsClipEnabled(renderer);
+  SDL_RenderGetClipRect(renderer, &previousClip);
+
+  float scaleX;
+  float scaleY;
+  SDL_RenderGetScale(renderer, &scaleX, &scaleY);
+  SDL_RenderSetScale(renderer, data->FramebufferScale.x,
+                     data->FramebufferScale.y);
+
+  for (ImDrawList const *list : data->CmdLists) {
+    ImDrawVert const *vertices = list->VtxBuffer.Data;
+    ImDrawIdx const *indices = list->IdxBuffer.Data;
+
+    for (ImDrawCmd const &command : list->CmdBuffer) {
+      if (command.UserCallback) {
+        command.UserCallback(list, &command);
+        continue;
+      }
+
+      ImVec2 offset = data->DisplayPos;
+      SDL_Rect clip{int(command.ClipRect.x - offset.x),
+                    int(command.ClipRect.y - offset.y),
+                    int(command.ClipRect.z - command.ClipRect.x),
+                    int(command.ClipRect.w - command.ClipRect.y)};
+      if (clip.w <= 0 || clip.h <= 0) {
+        continue;
+      }
+      SDL_RenderSetClipRect(renderer, &clip);
+
+      ImDrawVert const *first = vertices + command.VtxOffset;
+      SDL_RenderGeometryRaw(
+          renderer, static_cast<SDL_Texture *>(command.GetTexID()),
+          &first->pos.x, sizeof(ImDrawVert),
+          reinterpret_cast<SDL_Color const *>(&first->col),
+          sizeof(ImDrawVert), &first->uv.x, sizeof(ImDrawVert),
+          list->VtxBuffer.Size - command.VtxOffset,
+          indices + command.IdxOffset, command.ElemCount, sizeof(ImDrawIdx));
+    }
+  }
+
+  SDL_RenderSetScale(renderer, scaleX, scaleY);
+  SDL_RenderSetClipRect(renderer, clipped ? &previousClip : nullptr);
+}
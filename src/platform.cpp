@@ -1,4 +1,7 @@
 #include "../headers/platform.h"
+#ifdef CHIP8_PROFILE
+#include "../headers/overlay.h"
+#endif
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_pixels.h>
@@ -8,7 +11,8 @@
 #include <sys/types.h>
 
 Platform::Platform(char const *title, int windowWidth, int windowHeight,
-                   int textureWidth, int textureHeight) {
+                   int textureWidth, int textureHeight)
+    : textureWidth(textureWidth) {
   SDL_Init(SDL_INIT_VIDEO);
 
   window = SDL_CreateWindow(title, 0, 0, windowWidth, windowHeight,
@@ -21,17 +25,57 @@ Platform::Platform(char const *title, int windowWidth, int windowHeight,
                               textureHeight);
 }
 Platform::~Platform() {
+#ifdef CHIP8_PROFILE
+  overlay.reset();
+#endif
   SDL_DestroyTexture(texture);
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
   SDL_Quit();
 }
 
-void Platform::Update(void const *buffer, int pitch) {
-  SDL_UpdateTexture(texture, nullptr, buffer, pitch);
+void Platform::Update(void const *buffer, int pitch, int firstRow,
+                      int rowCount) {
+  // Upload only the rows that changed, buffer points at the first of them
+  SDL_Rect rows{0, firstRow, textureWidth, rowCount};
+  SDL_UpdateTexture(texture, &rows, buffer, pitch);
+  presentPending = true;
+}
+
+void Platform::SetTitle(char const *title) {
+  SDL_SetWindowTitle(window, title);
+}
+
+#ifdef CHIP8_PROFILE
+void Platform::ShowProfiler(Profiler const *profiler) {
+  this->profiler = profiler;
+
+  if (!overlay) {
+    overlay = std::make_unique<Overlay>(window, renderer);
+  }
+}
+#endif
+
+void Platform::Present() {
+#ifdef CHIP8_PROFILE
+  // The overlay's numbers change every frame
+  bool showOverlay = overlay && profiler && overlay->Visible();
+  presentPending |= showOverlay;
+#endif
+
+  if (!presentPending) {
+    return;
+  }
+
   SDL_RenderClear(renderer);
   SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+#ifdef CHIP8_PROFILE
+  if (showOverlay) {
+    overlay->Draw(*profiler);
+  }
+#endif
   SDL_RenderPresent(renderer);
+  presentPending = false;
 }
 
 bool Platform::ProcessInput(u_int8_t *keys) {
@@ -40,17 +84,36 @@ bool Platform::ProcessInput(u_int8_t *keys) {
   SDL_Event event;
 
   while (SDL_PollEvent(&event)) {
+#ifdef CHIP8_PROFILE
+    if (overlay) {
+      overlay->ProcessEvent(event);
+    }
+#endif
+
     switch (event.type) {
 
     case SDL_QUIT: {
       quit = true;
     } break;
+    case SDL_WINDOWEVENT: {
+      presentPending = true;
+    } break;
     case SDL_KEYDOWN: {
       switch (event.key.keysym.sym) {
       case SDLK_ESCAPE: {
         quit = true;
       } break;
 
+      case SDLK_BACKSPACE: {
+        rewindHeld = true;
+      } break;
+
+      case SDLK_TAB: {
+        if (!event.key.repeat) {
+          turbo = !turbo;
+        }
+      } break;
+
       case SDLK_x: {
         keys[0] = 1;
       } break;
@@ -104,6 +167,10 @@ bool Platform::ProcessInput(u_int8_t *keys) {
     }
     case SDL_KEYUP: {
       switch (event.key.keysym.sym) {
+      case SDLK_BACKSPACE: {
+        rewindHeld = false;
+      } break;
+
       case SDLK_x: {
         keys[0] = 0;
       } break;
@@ -0,0 +1,258 @@
+#include "../headers/profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+Profiler::Profiler() {
+  overhead = UINT64_MAX;
+  for (unsigned int i = 0; i < 64; ++i) {
+    uint64_t start = Ticks();
+    uint64_t ticks = Ticks() - start;
+    overhead = ticks < overhead ? ticks : overhead;
+  }
+}
+
+uint64_t Profiler::Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+char const *Profiler::Mnemonic(uint16_t opcode) {
+  static char const *const fixed[16] = {
+      nullptr, "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk", "7xkk",
+      nullptr, "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn", nullptr, nullptr};
+  static char const *const arithmetic[16] = {
+      "8xy0", "8xy1", "8xy2", "8xy3", "8xy4",  "8xy5",  "8xy6", "8xy7",
+      nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "8xyE", nullptr};
+
+  char const *mnemonic = nullptr;
+  switch (opcode >> 12u) {
+  case 0x0: {
+    static char const *const extended[16] = {
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+        nullptr, nullptr, nullptr, "00FB",  "00FC",  "00FD",  "00FE",  "00FF"};
+    if ((opcode & 0xFFF0u) == 0x00C0) {
+      mnemonic = "00Cn";
+    } else if ((opcode & 0xFFF0u) == 0x00D0) {
+      mnemonic = "00Dn";
+    } else if ((opcode & 0xFFF0u) == 0x00F0) {
+      mnemonic = extended[opcode & 0xFu];
+    } else {
+      mnemonic = opcode == 0x00E0   ? "00E0"
+                 : opcode == 0x00EE ? "00EE"
+                                    : nullptr;
+    }
+    break;
+  }
+  case 0x5:
+    mnemonic = (opcode & 0xFu) == 0x2   ? "5xy2"
+               : (opcode & 0xFu) == 0x3 ? "5xy3"
+                                        : "5xy0";
+    break;
+  case 0x8:
+    mnemonic = arithmetic[opcode & 0xFu];
+    break;
+  case 0xE:
+    mnemonic = (opcode & 0xFFu) == 0x9E   ? "Ex9E"
+               : (opcode & 0xFFu) == 0xA1 ? "ExA1"
+                                          : nullptr;
+    break;
+  case 0xF:
+    switch (opcode & 0xFFu) {
+    case 0x00:
+      mnemonic = opcode == 0xF000 ? "F000" : nullptr;
+      break;
+    case 0x01:
+      mnemonic = "Fn01";
+      break;
+    case 0x02:
+      mnemonic = opcode == 0xF002 ? "F002" : nullptr;
+      break;
+    case 0x07:
+      mnemonic = "Fx07";
+      break;
+    case 0x0A:
+      mnemonic = "Fx0A";
+      break;
+    case 0x15:
+      mnemonic = "Fx15";
+      break;
+    case 0x18:
+      mnemonic = "Fx18";
+      break;
+    case 0x1E:
+      mnemonic = "Fx1E";
+      break;
+    case 0x29:
+      mnemonic = "Fx29";
+      break;
+    case 0x33:
+      mnemonic = "Fx33";
+      break;
+    case 0x55:
+      mnemonic = "Fx55";
+      break;
+    case 0x30:
+      mnemonic = "Fx30";
+      break;
+    case 0x3A:
+      mnemonic = "Fx3A";
+      break;
+    case 0x65:
+      mnemonic = "Fx65";
+      break;
+    case 0x75:
+      mnemonic = "Fx75";
+      break;
+    case 0x85:
+      mnemonic = "Fx85";
+      break;
+    }
+    break;
+  default:
+    mnemonic = fixed[opcode >> 12u];
+    break;
+  }
+  return mnemonic ? mnemonic : "invalid";
+}
+
+uint64_t Profiler::CountAt(unsigned int address) const {
+  // Flow into an address is the flow into the one before it that did not
+  // jump away, plus the jumps landing on it
+  uint64_t count = 0;
+  for (unsigned int a = address & 1u; a < address; a += 2) {
+    count += entries[a].load(relaxed) - exits[a].load(relaxed);
+  }
+  return count + entries[address].load(relaxed);
+}
+
+std::vector<uint64_t> Profiler::Hits() const {
+  std::vector<uint64_t> hits(CODE_MEMORY);
+
+  for (unsigned int parity = 0; parity < 2; ++parity) {
+    uint64_t flow = 0;
+    for (unsigned int a = parity; a < CODE_MEMORY; a += 2) {
+      flow += entries[a].load(relaxed);
+      // Counters are read while they change, so clamp transient underflow
+      hits[a] = int64_t(flow) > 0 ? flow : 0;
+      flow -= exits[a].load(relaxed);
+    }
+  }
+  return hits;
+}
+
+void Profiler::Decoded(uint16_t address, uint16_t opcode) {
+  address = Mask(address);
+  uint16_t previous = opcodes[address].load(relaxed);
+
+  // The count already includes the execution that is about to happen
+  uint64_t count = CountAt(address) - 1;
+  uint64_t executed = SinceDecoded(address, count);
+
+  if (previous != opcode) {
+    if (executed > 0) {
+      std::lock_guard<std::mutex> lock(retiredMutex);
+      Retired &totals = retired[previous];
+      totals.count += executed;
+      totals.ticks += EstimatedTicks(address, executed);
+    }
+
+    decodedAt[address].store(count, relaxed);
+    ticks[address].store(0, relaxed);
+    samples[address].store(0, relaxed);
+  }
+
+  opcodes[address].store(opcode, relaxed);
+}
+
+uint64_t Profiler::SinceDecoded(unsigned int address, uint64_t count) const {
+  int64_t executed = count - decodedAt[address].load(relaxed);
+  return executed > 0 ? executed : 0;
+}
+
+uint64_t Profiler::EstimatedTicks(unsigned int address, uint64_t count) const {
+  uint64_t sampled = samples[address].load(relaxed);
+  return sampled ? ticks[address].load(relaxed) * count / sampled : 0;
+}
+
+std::vector<Profiler::OpcodeStats> Profiler::Opcodes() const {
+  std::map<std::string, OpcodeStats> totals;
+
+  auto add = [&totals](uint16_t opcode, uint64_t count, uint64_t ticks) {
+    char const *mnemonic = Mnemonic(opcode);
+    OpcodeStats &stats = totals[mnemonic];
+    stats.mnemonic = mnemonic;
+    stats.count += count;
+    stats.ticks += ticks;
+  };
+
+  std::vector<uint64_t> hits = Hits();
+  for (unsigned int address = 0; address < CODE_MEMORY; ++address) {
+    uint64_t executed = SinceDecoded(address, hits[address]);
+    if (executed > 0) {
+      add(opcodes[address].load(relaxed), executed,
+          EstimatedTicks(address, executed));
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    for (auto const &entry : retired) {
+      add(entry.first, entry.second.count, entry.second.ticks);
+    }
+  }
+
+  std::vector<OpcodeStats> result;
+  for (auto const &entry : totals) {
+    result.push_back(entry.second);
+  }
+  std::sort(result.begin(), result.end(),
+            [](OpcodeStats const &a, OpcodeStats const &b) {
+              return a.ticks != b.ticks ? a.ticks > b.ticks
+                                        : a.count > b.count;
+            });
+  return result;
+}
+
+std::vector<Profiler::Loop> Profiler::HotLoops(size_t count) const {
+  std::vector<uint64_t> hits = Hits();
+  std::vector<Loop> loops;
+
+  for (unsigned int end = 0; end < CODE_MEMORY; ++end) {
+    uint16_t opcode = opcodes[end].load(relaxed);
+    uint16_t start = opcode & 0x0FFFu;
+    uint64_t iterations = SinceDecoded(end, hits[end]);
+    if ((opcode >> 12u) != 0x1 || start > end || iterations == 0) {
+      continue;
+    }
+
+    Loop loop{start, uint16_t(end), iterations, 0};
+    for (unsigned int address = start; address <= end; ++address) {
+      loop.instructions += hits[address];
+    }
+    loops.push_back(loop);
+  }
+
+  std::sort(loops.begin(), loops.end(), [](Loop const &a, Loop const &b) {
+    return a.instructions > b.instructions;
+  });
+  if (loops.size() > count) {
+    loops.resize(count);
+  }
+  return loops;
+}
+
+uint64_t Profiler::Instructions() const {
+  uint64_t total = 0;
+  for (uint64_t hits : Hits()) {
+    total += hits;
+  }
+  return total;
+}
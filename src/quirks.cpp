@@ -0,0 +1,37 @@
+#include "../headers/quirks.h"
+#include <cstring>
+
+namespace {
+
+struct VariantNameEntry {
+  Variant variant;
+  char const *name;
+};
+
+VariantNameEntry const variantNames[] = {
+    {Variant::CosmacVip, "chip8"},
+    {Variant::Chip48, "chip48"},
+    {Variant::SuperChip, "schip"},
+    {Variant::XoChip, "xochip"},
+};
+
+} // namespace
+
+char const *VariantName(Variant variant) {
+  for (VariantNameEntry const &entry : variantNames) {
+    if (entry.variant == variant) {
+      return entry.name;
+    }
+  }
+  return "unknown";
+}
+
+bool ParseVariant(char const *name, Variant &variant) {
+  for (VariantNameEntry const &entry : variantNames) {
+    if (std::strcmp(entry.name, name) == 0) {
+      variant = entry.variant;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,369 @@
+#include "../headers/recompiler.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define CHIP8_RECOMPILER 1
+#endif
+
+namespace {
+
+const size_t BUFFER_SIZE = 1u << 20u;
+const size_t MAX_BLOCK_BYTES = 16384;
+const unsigned int MAX_BLOCK_LENGTH = 64;
+const size_t MAX_CONSTANTS = 16384;
+
+// x86-64 register numbers
+const uint8_t EAX = 0;
+const uint8_t ECX = 1;
+const uint8_t EDX = 2;
+
+class Emitter {
+public:
+  explicit Emitter(uint8_t *out) : start(out), out(out) {}
+
+  size_t Size() const { return out - start; }
+
+  void Bytes(std::initializer_list<uint8_t> bytes) {
+    for (uint8_t byte : bytes) {
+      *out++ = byte;
+    }
+  }
+
+  void Word(uint16_t value) { Raw(&value, sizeof(value)); }
+  void Dword(uint32_t value) { Raw(&value, sizeof(value)); }
+  void Qword(uint64_t value) { Raw(&value, sizeof(value)); }
+
+  // ModRM + disp32 addressing [rbx + disp]
+  void Mem(uint8_t reg, uint32_t disp) {
+    Bytes({uint8_t(0x80u | (reg << 3u) | 3u)});
+    Dword(disp);
+  }
+
+  // movzx reg, byte [rbx + disp]
+  void LoadByte(uint8_t reg, uint32_t disp) {
+    Bytes({0x0F, 0xB6});
+    Mem(reg, disp);
+  }
+
+  // mov byte [rbx + disp], reg8
+  void StoreByte(uint8_t reg, uint32_t disp) {
+    Bytes({0x88});
+    Mem(reg, disp);
+  }
+
+  // mov word [rbx + disp], reg16
+  void StoreWord(uint8_t reg, uint32_t disp) {
+    Bytes({0x66, 0x89});
+    Mem(reg, disp);
+  }
+
+  // mov word [rbx + disp], imm16
+  void StoreWordImm(uint32_t disp, uint16_t value) {
+    Bytes({0x66, 0xC7});
+    Mem(0, disp);
+    Word(value);
+  }
+
+  // mov reg, imm32
+  void MovImm(uint8_t reg, uint32_t value) {
+    Bytes({uint8_t(0xB8u + reg)});
+    Dword(value);
+  }
+
+private:
+  void Raw(void const *data, size_t size) {
+    memcpy(out, data, size);
+    out += size;
+  }
+
+  uint8_t *start;
+  uint8_t *out;
+};
+
+} // namespace
+
+Recompiler::Recompiler(Chip8 &chip8) : chip8(chip8) {
+#ifdef CHIP8_RECOMPILER
+  // The same memory mapped twice, written through one view and run from
+  // the other, so no page is ever writable and executable at once
+  int file = memfd_create("chip8-recompiler", MFD_CLOEXEC);
+  if (file >= 0 && ftruncate(file, BUFFER_SIZE) == 0) {
+    void *written = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, file, 0);
+    void *run = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED,
+                     file, 0);
+    if (written != MAP_FAILED && run != MAP_FAILED) {
+      buffer = static_cast<uint8_t *>(written);
+      runnable = static_cast<uint8_t *>(run);
+    } else {
+      // Refused where policy forbids executable memory; interpret instead
+      if (written != MAP_FAILED) {
+        munmap(written, BUFFER_SIZE);
+      }
+      if (run != MAP_FAILED) {
+        munmap(run, BUFFER_SIZE);
+      }
+    }
+  }
+  if (file >= 0) {
+    close(file);
+  }
+#endif
+
+  constants.reserve(MAX_CONSTANTS);
+  generation = chip8.codeGeneration;
+}
+
+Recompiler::~Recompiler() {
+#ifdef CHIP8_RECOMPILER
+  if (buffer) {
+    munmap(buffer, BUFFER_SIZE);
+    munmap(runnable, BUFFER_SIZE);
+  }
+#endif
+}
+
+bool Recompiler::Supported() {
+#ifdef CHIP8_RECOMPILER
+  return true;
+#else
+  return false;
+#endif
+}
+
+uint32_t Recompiler::Run(uint32_t cycles) {
+  while (cycles > 0) {
+    // Drop every block once a store has modified decoded code
+    if (chip8.codeGeneration != generation) {
+      Flush();
+    }
+
+    uint16_t pc = chip8.pc;
+    Block *block = nullptr;
+    if (buffer && pc < CODE_MEMORY - 1u) {
+      block = &blocks[pc];
+      if (!block->code) {
+        Compile(pc);
+      }
+    }
+
+    // Finish with the interpreter when the block would overrun the budget
+    if (!block || block->length > cycles) {
+      chip8.Cycle();
+      --cycles;
+    } else {
+      block->code(&chip8);
+      cycles -= block->length;
+    }
+
+    // Only the last instruction of a block can stop the machine
+    if (chip8.stopReason != StopReason::Budget) {
+      return cycles;
+    }
+
+    // Control coming back may close an idle loop
+    if (chip8.pc <= pc) {
+      cycles -= chip8.FastForward(cycles);
+    }
+  }
+  return 0;
+}
+
+void Recompiler::Flush() {
+  memset(blocks, 0, sizeof(blocks));
+  used = 0;
+  constants.clear();
+  generation = chip8.codeGeneration;
+}
+
+Recompiler::Block &Recompiler::Compile(uint16_t address) {
+  typedef Chip8::Instruction Instruction;
+
+  if (BUFFER_SIZE - used < MAX_BLOCK_BYTES ||
+      MAX_CONSTANTS - constants.size() < MAX_BLOCK_LENGTH) {
+    Flush();
+  }
+
+  char const *base = reinterpret_cast<char const *>(&chip8);
+  uint32_t const registers =
+      reinterpret_cast<char const *>(&chip8.registers) - base;
+  uint32_t const pcOffset = reinterpret_cast<char const *>(&chip8.pc) - base;
+  uint32_t const index = reinterpret_cast<char const *>(&chip8.index) - base;
+  uint32_t const flag = registers + 0xFu;
+
+  Emitter e(buffer + used);
+
+  // push rbx; mov rbx, rdi
+  e.Bytes({0x53, 0x48, 0x89, 0xFB});
+
+  uint16_t pc = address;
+  uint32_t length = 0;
+  bool terminated = false;
+
+  while (!terminated && length < MAX_BLOCK_LENGTH &&
+         pc < CODE_MEMORY - 1u) {
+    if (!chip8.decoded[pc].handler) {
+      chip8.Decode(pc);
+    }
+    Instruction const op = chip8.decoded[pc];
+    Chip8::Handler handler = op.handler;
+    uint16_t next = pc + 2u;
+    uint32_t vx = registers + op.x;
+    uint32_t vy = registers + op.y;
+
+    ++length;
+
+    if (handler == &Chip8::Invoke<&Chip8::OP_6xkk>) {
+      // mov byte [Vx], kk
+      e.Bytes({0xC6});
+      e.Mem(0, vx);
+      e.Bytes({op.kk});
+    } else if (handler == &Chip8::Invoke<&Chip8::OP_7xkk>) {
+      // add byte [Vx], kk
+      e.Bytes({0x80});
+      e.Mem(0, vx);
+      e.Bytes({op.kk});
+    } else if (handler == &Chip8::Invoke<&Chip8::OP_8xy0>) {
+      e.LoadByte(EAX, vy);
+      e.StoreByte(EAX, vx);
+    } else if (handler == &Chip8::Invoke<&Chip8::OP_8xy1<false>> ||
+               handler == &Chip8::Invoke<&Chip8::OP_8xy2<false>> ||
+               handler == &Chip8::Invoke<&Chip8::OP_8xy3<false>> ||
+               handler == &Chip8::Invoke<&Chip8::OP_8xy1<true>> ||
+               handler == &Chip8::Invoke<&Chip8::OP_8xy2<true>> ||
+               handler == &Chip8::Invoke<&Chip8::OP_8xy3<true>>) {
+      // or/and/xor byte [Vx], al
+      uint8_t const alu[] = {0x00, 0x08, 0x20, 0x30};
+      e.LoadByte(EAX, vy);
+      e.Bytes({alu[op.n]});
+      e.Mem(EAX, vx);
+      // mov byte [VF], 0 for the variants that reset the flag
+      if (handler == &Chip8::Invoke<&Chip8::OP_8xy1<true>> ||
+          handler == &Chip8::Invoke<&Chip8::OP_8xy2<true>> ||
+          handler == &Chip8::Invoke<&Chip8::OP_8xy3<true>>) {
+        e.Bytes({0xC6});
+        e.Mem(0, flag);
+        e.Bytes({0x00});
+      }
+    } else if (handler == &Chip8::Invoke<&Chip8::OP_8xy4>) {
+      // VF is written before Vx, so Vx wins when x is F
+      e.LoadByte(EAX, vx);
+      e.LoadByte(ECX, vy);
+      e.Bytes({0x01, 0xC8});       // add eax, ecx
+      e.Bytes({0x89, 0xC2});       // mov edx, eax
+      e.Bytes({0xC1, 0xEA, 0x08}); // shr edx, 8
+      e.StoreByte(EDX, flag);
+      e.StoreByte(EAX, vx);
+    } else if (handler == &Chip8::Invoke<&Chip8::OP_8xy5> ||
+               handler == &Chip8::Invoke<&Chip8::OP_8xy7>) {
+      bool reverse = handler == &Chip8::Invoke<&Chip8::OP_8xy7>;
+      e.LoadByte(EAX, vx);
+      e.LoadByte(ECX, vy);
+      // cmp eax, ecx (or ecx, eax); seta dl
+      e.Bytes({0x39, uint8_t(reverse ? 0xC1 : 0xC8), 0x0F, 0x97, 0xC2});
+      e.StoreByte(EDX, flag);
+      // Reload, as the flag may have overwritten an operand
+      e.LoadByte(EAX, vx);
+      e.LoadByte(ECX, vy);
+      if (reverse) {
+        e.Bytes({0x29, 0xC1}); // sub ecx, eax
+        e.StoreByte(ECX, vx);
+      } else {
+        e.Bytes({0x29, 0xC8}); // sub eax, ecx
+        e.StoreByte(EAX, vx);
+      }
+    } else if (handler == &Chip8::Invoke<&Chip8::OP_Annn>) {
+      e.StoreWordImm(index, op.nnn);
+    } else if (handler == &Chip8::Invoke<&Chip8::OP_Fx1E>) {
+      // movzx eax, [Vx]; add word [index], ax
+      e.LoadByte(EAX, vx);
+      e.Bytes({0x66, 0x01});
+      e.Mem(EAX, index);
+    } else if (handler == &Chip8::Invoke<&Chip8::OP_1nnn>) {
+      e.StoreWordImm(pcOffset, op.nnn);
+      terminated = true;
+    } else if (handler == &Chip8::Invoke<&Chip8::OP_3xkk<false>> ||
+               handler == &Chip8::Invoke<&Chip8::OP_4xkk<false>> ||
+               handler == &Chip8::Invoke<&Chip8::OP_5xy0<false>> ||
+               handler == &Chip8::Invoke<&Chip8::OP_9xy0<false>>) {
+      e.MovImm(EAX, next);
+      e.MovImm(ECX, uint16_t(next + 2u));
+      if (handler == &Chip8::Invoke<&Chip8::OP_3xkk<false>> ||
+          handler == &Chip8::Invoke<&Chip8::OP_4xkk<false>>) {
+        // cmp byte [Vx], kk
+        e.Bytes({0x80});
+        e.Mem(7, vx);
+        e.Bytes({op.kk});
+      } else {
+        // movzx edx, [Vx]; cmp dl, [Vy]
+        e.LoadByte(EDX, vx);
+        e.Bytes({0x3A});
+        e.Mem(EDX, vy);
+      }
+      bool skipIfEqual =
+          handler == &Chip8::Invoke<&Chip8::OP_3xkk<false>> ||
+          handler == &Chip8::Invoke<&Chip8::OP_5xy0<false>>;
+      // cmove/cmovne eax, ecx
+      e.Bytes({0x0F, uint8_t(skipIfEqual ? 0x44 : 0x45), 0xC1});
+      e.StoreWord(EAX, pcOffset);
+      terminated = true;
+    } else {
+      // Fall back to the handler, with PC as the interpreter would leave it
+      constants.push_back(op);
+      e.StoreWordImm(pcOffset, next);
+      // mov rdi, rbx; mov rsi, imm64; mov rax, imm64; call rax
+      e.Bytes({0x48, 0x89, 0xDF, 0x48, 0xBE});
+      e.Qword(reinterpret_cast<uint64_t>(&constants.back()));
+      e.Bytes({0x48, 0xB8});
+      e.Qword(reinterpret_cast<uint64_t>(handler));
+      e.Bytes({0xFF, 0xD0});
+
+      // Control flow, draws, key waits and stores end the block, and so
+      // do invalid opcodes while they stop the machine, so that whatever
+      // stops it comes last
+      bool invalid = handler == &Chip8::Invoke<&Chip8::OP_NULL>;
+      bool stops = invalid && chip8.stopOnFault;
+      switch (op.opcode >> 12u) {
+      case 0x0:
+        // Every valid one returns, draws or exits
+        terminated = !invalid || stops;
+        break;
+      case 0xF:
+        terminated = op.kk == 0x00 || op.kk == 0x0A || op.kk == 0x33 ||
+                     op.kk == 0x55 || stops;
+        break;
+      case 0x8:
+        terminated = stops;
+        break;
+      case 0x6:
+      case 0x7:
+      case 0xA:
+      case 0xC:
+        break;
+      default:
+        terminated = true;
+        break;
+      }
+    }
+
+    pc = next;
+  }
+
+  if (!terminated) {
+    e.StoreWordImm(pcOffset, pc);
+  }
+
+  // pop rbx; ret
+  e.Bytes({0x5B, 0xC3});
+
+  Block &block = blocks[address];
+  block.code = reinterpret_cast<Code>(runnable + used);
+  block.length = length;
+  used += e.Size();
+  return block;
+}
@@ -0,0 +1,120 @@
+#include "../headers/chip8.h"
+#include "../headers/input_log.h"
+#include "../headers/trace_log.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+void Usage(char const *program) {
+  std::cerr << "Usage: " << program
+            << " <Log> <ROM> [--engine interpreter|recompiler]"
+               " [--repeat N] [--trace FILE]\n";
+  std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+// Re-runs a session recorded with --record as fast as possible and prints
+// the hash of the final machine state
+int main(int argc, char **argv) {
+  Engine engine = Engine::Interpreter;
+  unsigned long repeat = 1;
+  char const *traceFilename = nullptr;
+  std::vector<char const *> files;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      ++i;
+      if (std::strcmp(argv[i], "interpreter") == 0) {
+        engine = Engine::Interpreter;
+      } else if (std::strcmp(argv[i], "recompiler") == 0) {
+        engine = Engine::Recompiler;
+      } else {
+        Usage(argv[0]);
+      }
+    } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      traceFilename = argv[++i];
+    } else if (argv[i][0] == '-') {
+      Usage(argv[0]);
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+
+  if (files.size() != 2 || repeat == 0) {
+    Usage(argv[0]);
+  }
+
+  InputLog log;
+  if (!log.Load(files[0])) {
+    std::cerr << "Could not read input log " << files[0] << "\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  // Only the first run is traced, the others repeat it exactly
+  TraceWriter tracer;
+  std::string error;
+  if (traceFilename &&
+      !tracer.Open(traceFilename, log.GetVariant(), error)) {
+    std::cerr << error << "\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  uint64_t finalHash = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned long run = 0; run < repeat; ++run) {
+    Chip8 chip8(log.Seed(), log.GetVariant());
+    chip8.SetEngine(engine);
+    if (!chip8.LoadROM(files[1], error)) {
+      std::cerr << error << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+
+    if (chip8.StateHash() != log.InitialHash()) {
+      std::cerr << files[1] << " is not the ROM this session was recorded"
+                << " with\n";
+      std::exit(EXIT_FAILURE);
+    }
+    if (traceFilename && run == 0) {
+      chip8.SetTracer(&tracer);
+    }
+
+    for (uint32_t frame = 0; frame < log.FrameCount(); ++frame) {
+      chip8.SetKeypad(log.KeysAt(frame));
+      chip8.RunFrame(log.InstructionsPerFrame());
+    }
+
+    uint64_t hash = chip8.StateHash();
+    if (run > 0 && hash != finalHash) {
+      std::cerr << "Run " << run << " diverged\n";
+      std::exit(EXIT_FAILURE);
+    }
+    finalHash = hash;
+  }
+
+  if (traceFilename && !tracer.Close()) {
+    std::cerr << "Could not write " << traceFilename << "\n";
+    std::exit(EXIT_FAILURE);
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double recorded = log.FrameCount() / 60.0 * repeat;
+
+  std::printf("%016llx\n", (unsigned long long)finalHash);
+  std::fprintf(stderr,
+               "%u frames, %zu input events, %.3f s (%.0fx real time)\n",
+               log.FrameCount(), log.Events().size(), seconds,
+               seconds > 0 ? recorded / seconds : 0.0);
+  return 0;
+}
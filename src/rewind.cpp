@@ -0,0 +1,176 @@
+#include "../headers/rewind.h"
+#include <cstring>
+
+namespace {
+
+uint8_t *WriteVarint(uint8_t *out, size_t value) {
+  while (value >= 0x80) {
+    *out++ = value | 0x80u;
+    value >>= 7u;
+  }
+  *out++ = value;
+  return out;
+}
+
+uint8_t const *ReadVarint(uint8_t const *in, size_t &value) {
+  value = 0;
+  for (unsigned int shift = 0;; shift += 7) {
+    uint8_t byte = *in++;
+    value |= size_t(byte & 0x7Fu) << shift;
+    if (!(byte & 0x80u)) {
+      return in;
+    }
+  }
+}
+
+Chip8State const zeroState{};
+
+} // namespace
+
+RewindBuffer::RewindBuffer(size_t capacityBytes, unsigned int keyframeInterval)
+    : arena(capacityBytes), keyframeInterval(keyframeInterval) {}
+
+size_t RewindBuffer::Encode(uint8_t const *a, uint8_t const *b, size_t size,
+                            uint8_t *out) {
+  // A sequence of (zero run length, literal length, literal XOR bytes)
+  uint8_t *start = out;
+  size_t i = 0;
+
+  while (i < size) {
+    size_t zeros = i;
+    while (zeros + 8 <= size && memcmp(&a[zeros], &b[zeros], 8) == 0) {
+      zeros += 8;
+    }
+    while (zeros < size && a[zeros] == b[zeros]) {
+      ++zeros;
+    }
+    if (zeros == size) {
+      break;
+    }
+
+    // Literals run until two equal bytes in a row, or the end
+    size_t literals = zeros;
+    while (literals < size &&
+           (a[literals] != b[literals] ||
+            (literals + 1 < size && a[literals + 1] != b[literals + 1]))) {
+      ++literals;
+    }
+
+    out = WriteVarint(out, zeros - i);
+    out = WriteVarint(out, literals - zeros);
+    for (size_t j = zeros; j < literals; ++j) {
+      *out++ = a[j] ^ b[j];
+    }
+    i = literals;
+  }
+
+  return out - start;
+}
+
+void RewindBuffer::Decode(uint8_t const *in, size_t size, uint8_t *target) {
+  uint8_t const *end = in + size;
+  size_t position = 0;
+
+  while (in < end) {
+    size_t zeros;
+    size_t literals;
+    in = ReadVarint(in, zeros);
+    in = ReadVarint(in, literals);
+
+    position += zeros;
+    for (size_t j = 0; j < literals; ++j) {
+      target[position++] ^= *in++;
+    }
+  }
+}
+
+void RewindBuffer::Push(Chip8State const &state) {
+  size_t const bound = MaxEncodedSize(sizeof(Chip8State));
+  if (bound > arena.size()) {
+    return;
+  }
+
+  if (head + bound > arena.size()) {
+    // Entries past the write position are the oldest and can't survive
+    // the wrap
+    while (!entries.empty() && entries.front().offset >= head) {
+      EvictOldest();
+    }
+    head = 0;
+  }
+
+  while (!entries.empty() && entries.front().offset >= head &&
+         entries.front().offset < head + bound) {
+    EvictOldest();
+  }
+
+  bool keyframe = entries.empty() || sinceKeyframe + 1 >= keyframeInterval;
+  Chip8State const &base = keyframe ? zeroState : last;
+
+  Entry entry;
+  entry.offset = head;
+  entry.size = Encode(reinterpret_cast<uint8_t const *>(&state),
+                      reinterpret_cast<uint8_t const *>(&base),
+                      sizeof(Chip8State), &arena[head]);
+  entry.keyframe = keyframe;
+
+  entries.push_back(entry);
+  head += entry.size;
+  bytesUsed += entry.size;
+  sinceKeyframe = keyframe ? 0 : sinceKeyframe + 1;
+  last = state;
+}
+
+bool RewindBuffer::Pop(Chip8State &state) {
+  if (entries.empty()) {
+    return false;
+  }
+
+  state = last;
+  Entry newest = entries.back();
+  entries.pop_back();
+  bytesUsed -= newest.size;
+  head = newest.offset;
+
+  if (entries.empty()) {
+    sinceKeyframe = 0;
+    return true;
+  }
+
+  uint8_t *lastBytes = reinterpret_cast<uint8_t *>(&last);
+
+  if (!newest.keyframe) {
+    // Undo the delta to get the snapshot before it
+    Decode(&arena[newest.offset], newest.size, lastBytes);
+    --sinceKeyframe;
+    return true;
+  }
+
+  // Crossing a keyframe backwards, replay the previous group forwards
+  size_t key = entries.size() - 1;
+  while (!entries[key].keyframe) {
+    --key;
+  }
+
+  last = zeroState;
+  for (size_t i = key; i < entries.size(); ++i) {
+    Decode(&arena[entries[i].offset], entries[i].size, lastBytes);
+  }
+  sinceKeyframe = entries.size() - 1 - key;
+  return true;
+}
+
+void RewindBuffer::Clear() {
+  entries.clear();
+  head = 0;
+  bytesUsed = 0;
+  sinceKeyframe = 0;
+}
+
+void RewindBuffer::EvictOldest() {
+  // Evict a whole keyframe group so the front is always a keyframe
+  do {
+    bytesUsed -= entries.front().size;
+    entries.pop_front();
+  } while (!entries.empty() && !entries.front().keyframe);
+}
@@ -0,0 +1,216 @@
+#include "../headers/rom_database.h"
+#include "../headers/hash.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+char const MAGIC[4] = {'C', '8', 'D', 'B'};
+const uint32_t VERSION = 1;
+const size_t HEADER_SIZE = 16;
+
+// Little-endian: hash, keymap as 16 nibbles with key 0 lowest,
+// instructions per frame, variant, then padding to 24 bytes
+const size_t RECORD_SIZE = 24;
+
+// XO-CHIP programs may use all 64 KB, everything else fits in 4 KB
+const size_t CLASSIC_ROM_SIZE = CODE_MEMORY - START_ADDRESS;
+
+uint64_t Load64(uint8_t const *p) {
+  uint64_t value = 0;
+  for (unsigned int i = 0; i < 8; ++i) {
+    value |= uint64_t(p[i]) << (8 * i);
+  }
+  return value;
+}
+
+uint32_t Load32(uint8_t const *p) {
+  return p[0] | p[1] << 8u | p[2] << 16u | uint32_t(p[3]) << 24u;
+}
+
+void Store64(uint8_t *p, uint64_t value) {
+  for (unsigned int i = 0; i < 8; ++i) {
+    p[i] = value >> (8 * i);
+  }
+}
+
+void Store32(uint8_t *p, uint32_t value) {
+  for (unsigned int i = 0; i < 4; ++i) {
+    p[i] = value >> (8 * i);
+  }
+}
+
+RomEntry DecodeRecord(uint8_t const *record) {
+  RomEntry entry;
+  entry.hash = Load64(record);
+
+  uint64_t keymap = Load64(record + 8);
+  for (unsigned int key = 0; key < KEY_COUNT; ++key) {
+    entry.settings.keymap[key] = (keymap >> (4 * key)) & 0xFu;
+  }
+  entry.settings.instructionsPerFrame = record[16] | record[17] << 8u;
+  if (record[18] <= uint8_t(Variant::XoChip)) {
+    entry.settings.variant = Variant(record[18]);
+  }
+  return entry;
+}
+
+} // namespace
+
+uint64_t RomHash(uint8_t const *data, size_t size) {
+  return Hash64(data, size);
+}
+
+Variant DetectVariant(uint8_t const *data, size_t size) {
+  if (size > CLASSIC_ROM_SIZE) {
+    return Variant::XoChip;
+  }
+
+  unsigned int superChip = 0;
+  unsigned int xoChip = 0;
+
+  for (size_t i = 0; i + 1 < size; i += 2) {
+    uint16_t opcode = data[i] << 8u | data[i + 1];
+    uint8_t kk = opcode & 0xFFu;
+
+    switch (opcode >> 12u) {
+    case 0x0:
+      if (opcode == 0x00FE || opcode == 0x00FF) {
+        // Switching resolution is the surest sign, sprites rarely hold it
+        superChip += 2;
+      } else if (opcode == 0x00FB || opcode == 0x00FC || opcode == 0x00FD ||
+                 (opcode & 0xFFF0u) == 0x00C0) {
+        ++superChip;
+      } else if ((opcode & 0xFFF0u) == 0x00D0) {
+        ++xoChip;
+      }
+      break;
+    case 0x5:
+      if ((opcode & 0xFu) == 2 || (opcode & 0xFu) == 3) {
+        ++xoChip;
+      }
+      break;
+    case 0xF:
+      if (opcode == 0xF000 || kk == 0x01 || kk == 0x02 || kk == 0x3A) {
+        ++xoChip;
+      } else if (kk == 0x30 || kk == 0x75 || kk == 0x85) {
+        ++superChip;
+      }
+      break;
+    }
+  }
+
+  // A lone match is as likely to be sprite data as an instruction
+  if (xoChip >= 2) {
+    return Variant::XoChip;
+  }
+  if (superChip >= 2) {
+    return Variant::SuperChip;
+  }
+  return Variant::CosmacVip;
+}
+
+bool RomDatabase::Open(char const *filename, std::string &error) {
+  records = nullptr;
+  count = 0;
+  if (!file.Open(filename, error)) {
+    return false;
+  }
+
+  uint8_t const *data = file.Data();
+  if (file.Size() < HEADER_SIZE || memcmp(data, MAGIC, sizeof(MAGIC)) != 0 ||
+      Load32(data + 4) != VERSION) {
+    error = std::string(filename) + " is not a ROM database";
+    file.Close();
+    return false;
+  }
+
+  size_t entries = Load32(data + 8);
+  if (entries > (file.Size() - HEADER_SIZE) / RECORD_SIZE) {
+    error = std::string(filename) + " is truncated";
+    file.Close();
+    return false;
+  }
+
+  records = data + HEADER_SIZE;
+  count = entries;
+  return true;
+}
+
+bool RomDatabase::Find(uint64_t hash, RomSettings &settings) const {
+  size_t low = 0;
+  size_t high = count;
+
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    uint64_t found = Load64(records + middle * RECORD_SIZE);
+    if (found == hash) {
+      settings = DecodeRecord(records + middle * RECORD_SIZE).settings;
+      return true;
+    }
+    if (found < hash) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return false;
+}
+
+std::vector<RomEntry> RomDatabase::Entries() const {
+  std::vector<RomEntry> entries;
+  entries.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    entries.push_back(DecodeRecord(records + i * RECORD_SIZE));
+  }
+  return entries;
+}
+
+bool RomDatabase::Save(char const *filename, std::vector<RomEntry> entries,
+                       std::string &error) {
+  // Later entries for the same ROM replace earlier ones
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](RomEntry const &a, RomEntry const &b) {
+                     return a.hash < b.hash;
+                   });
+  auto kept = std::unique(entries.rbegin(), entries.rend(),
+                          [](RomEntry const &a, RomEntry const &b) {
+                            return a.hash == b.hash;
+                          });
+  entries.erase(entries.begin(), kept.base());
+
+  std::vector<uint8_t> image(HEADER_SIZE + entries.size() * RECORD_SIZE);
+  memcpy(image.data(), MAGIC, sizeof(MAGIC));
+  Store32(&image[4], VERSION);
+  Store32(&image[8], entries.size());
+
+  uint8_t *record = image.data() + HEADER_SIZE;
+  for (RomEntry const &entry : entries) {
+    uint64_t keymap = 0;
+    for (unsigned int key = 0; key < KEY_COUNT; ++key) {
+      keymap |= uint64_t(entry.settings.keymap[key] & 0xFu) << (4 * key);
+    }
+    Store64(record, entry.hash);
+    Store64(record + 8, keymap);
+    record[16] = entry.settings.instructionsPerFrame & 0xFFu;
+    record[17] = entry.settings.instructionsPerFrame >> 8u;
+    record[18] = uint8_t(entry.settings.variant);
+    record += RECORD_SIZE;
+  }
+
+  // Written aside and renamed over, so a reader never maps half a file
+  std::string temporary = std::string(filename) + ".tmp";
+  std::FILE *out = std::fopen(temporary.c_str(), "wb");
+  bool written = out && std::fwrite(image.data(), 1, image.size(), out) ==
+                            image.size();
+  if (out && std::fclose(out) != 0) {
+    written = false;
+  }
+  if (!written || std::rename(temporary.c_str(), filename) != 0) {
+    std::remove(temporary.c_str());
+    error = std::string("cannot write ") + filename;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,162 @@
+#include "../headers/mapped_file.h"
+#include "../headers/rom_database.h"
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+void Usage(char const *program) {
+  std::cerr << "Usage: " << program << " <Database> list\n"
+            << "       " << program
+            << " <Database> add <ROM> [--variant chip8|chip48|schip|xochip]"
+               " [--speed N] [--keymap KEYS]\n"
+            << "       " << program << " <Database> remove <ROM>\n"
+            << "       " << program << " <Database> lookup <ROM>\n"
+            << "KEYS is 16 hex digits, the n-th naming the keypad key that"
+               " drives CHIP-8 key n\n";
+  std::exit(EXIT_FAILURE);
+}
+
+[[noreturn]] void Fail(std::string const &error) {
+  std::cerr << error << "\n";
+  std::exit(EXIT_FAILURE);
+}
+
+bool ParseKeymap(char const *text, uint8_t *keymap) {
+  if (std::strlen(text) != KEY_COUNT) {
+    return false;
+  }
+  for (unsigned int key = 0; key < KEY_COUNT; ++key) {
+    char digit[2] = {text[key], 0};
+    char *end;
+    keymap[key] = std::strtoul(digit, &end, 16);
+    if (*end != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Print(uint64_t hash, RomSettings const &settings, char const *note) {
+  std::printf("%016" PRIx64 " %-6s %5u ", hash, VariantName(settings.variant),
+              settings.instructionsPerFrame);
+  for (uint8_t key : settings.keymap) {
+    std::printf("%X", key);
+  }
+  std::printf("%s\n", note);
+}
+
+} // namespace
+
+// Maintains the per-ROM settings database the emulator reads with --db
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    Usage(argv[0]);
+  }
+
+  char const *filename = argv[1];
+  std::string command = argv[2];
+  std::string error;
+
+  RomDatabase database;
+  bool opened = database.Open(filename, error);
+
+  if (command == "list" && argc == 3) {
+    if (!opened) {
+      Fail(error);
+    }
+    for (RomEntry const &entry : database.Entries()) {
+      Print(entry.hash, entry.settings, "");
+    }
+    return 0;
+  }
+
+  if (argc < 4) {
+    Usage(argv[0]);
+  }
+  char const *romFilename = argv[3];
+  MappedFile rom;
+  if (!rom.Open(romFilename, error)) {
+    Fail(error);
+  }
+  uint64_t hash = RomHash(rom.Data(), rom.Size());
+
+  if (command == "lookup" && argc == 4) {
+    RomSettings settings;
+    if (opened && database.Find(hash, settings)) {
+      Print(hash, settings, "");
+    } else {
+      settings.variant = DetectVariant(rom.Data(), rom.Size());
+      Print(hash, settings, " (not in the database, variant detected)");
+    }
+    return 0;
+  }
+
+  if (command == "add") {
+    // Only a missing database is created, never one that failed to open
+    if (!opened && std::filesystem::exists(filename)) {
+      Fail(error);
+    }
+
+    RomEntry entry{hash, {}};
+    bool variantGiven = false;
+
+    for (int i = 4; i < argc; ++i) {
+      if (std::strcmp(argv[i], "--variant") == 0 && i + 1 < argc &&
+          ParseVariant(argv[i + 1], entry.settings.variant)) {
+        variantGiven = true;
+        ++i;
+      } else if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+        entry.settings.instructionsPerFrame =
+            std::strtoul(argv[++i], nullptr, 10);
+      } else if (std::strcmp(argv[i], "--keymap") == 0 && i + 1 < argc &&
+                 ParseKeymap(argv[i + 1], entry.settings.keymap)) {
+        ++i;
+      } else {
+        Usage(argv[0]);
+      }
+    }
+
+    if (!variantGiven) {
+      entry.settings.variant = DetectVariant(rom.Data(), rom.Size());
+    }
+
+    std::vector<RomEntry> entries = database.Entries();
+    entries.push_back(entry);
+    if (!RomDatabase::Save(filename, entries, error)) {
+      Fail(error);
+    }
+    Print(entry.hash, entry.settings, "");
+    return 0;
+  }
+
+  if (command == "remove" && argc == 4) {
+    if (!opened) {
+      Fail(error);
+    }
+
+    std::vector<RomEntry> entries = database.Entries();
+    size_t before = entries.size();
+    for (size_t i = entries.size(); i-- > 0;) {
+      if (entries[i].hash == hash) {
+        entries.erase(entries.begin() + i);
+      }
+    }
+    if (entries.size() == before) {
+      Fail(std::string(romFilename) + " is not in the database");
+    }
+    if (!RomDatabase::Save(filename, entries, error)) {
+      Fail(error);
+    }
+    return 0;
+  }
+
+  Usage(argv[0]);
+}
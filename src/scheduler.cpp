@@ -0,0 +1,32 @@
+#include "../headers/scheduler.h"
+#include <chrono>
+#include <thread>
+
+FrameScheduler::FrameScheduler(double framesPerSecond, unsigned int maxCatchUp)
+    : period(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1.0 / framesPerSecond))),
+      next(Clock::now()), maxCatchUp(maxCatchUp) {}
+
+unsigned int FrameScheduler::FramesDue() {
+  Clock::time_point now = Clock::now();
+
+  if (now < next) {
+    return 0;
+  }
+
+  unsigned int frames = (now - next) / period + 1;
+
+  if (frames > maxCatchUp) {
+    // Too far behind to catch up, drop the backlog
+    frames = maxCatchUp;
+    next = now + period;
+  } else {
+    next += frames * period;
+  }
+
+  return frames;
+}
+
+void FrameScheduler::WaitForNextFrame() const {
+  std::this_thread::sleep_until(next);
+}
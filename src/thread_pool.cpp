@@ -0,0 +1,91 @@
+#include "../headers/thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  size = threads;
+  shares = std::make_unique<Share[]>(size);
+
+  for (unsigned int id = 1; id < size; ++id) {
+    this->threads.emplace_back(&ThreadPool::Worker, this, id);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::ParallelFor(
+    size_t count, std::function<void(size_t begin, size_t end)> const &body) {
+  if (count == 0) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    this->body = &body;
+    chunk = std::max<size_t>(1, count / (size * 8u));
+
+    for (unsigned int id = 0; id < size; ++id) {
+      shares[id].next = count * id / size;
+      shares[id].end = count * (id + 1u) / size;
+    }
+
+    busy = size - 1u;
+    ++generation;
+  }
+  wake.notify_all();
+
+  Work(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this]() { return busy == 0; });
+}
+
+void ThreadPool::Worker(unsigned int id) {
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+
+  for (;;) {
+    wake.wait(lock, [&]() { return stopping || generation != seen; });
+    if (stopping) {
+      return;
+    }
+    seen = generation;
+
+    lock.unlock();
+    Work(id);
+    lock.lock();
+
+    if (--busy == 0) {
+      done.notify_one();
+    }
+  }
+}
+
+void ThreadPool::Work(unsigned int id) {
+  // Own share first, then steal from the others in turn
+  for (unsigned int i = 0; i < size; ++i) {
+    Share &share = shares[(id + i) % size];
+
+    for (;;) {
+      size_t begin = share.next.fetch_add(chunk, std::memory_order_relaxed);
+      if (begin >= share.end) {
+        break;
+      }
+      (*body)(begin, std::min(begin + chunk, share.end));
+    }
+  }
+}
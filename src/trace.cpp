@@ -0,0 +1,144 @@
+#include "../headers/disassembler.h"
+#include "../headers/trace_log.h"
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace {
+
+// Matches opcodes against four hex digits, '.' matching any digit
+bool ParsePattern(char const *text, uint16_t &mask, uint16_t &value) {
+  if (std::strlen(text) != 4) {
+    return false;
+  }
+
+  mask = 0;
+  value = 0;
+  for (unsigned int i = 0; i < 4; ++i) {
+    char digit[2] = {text[i], 0};
+    char *end;
+    unsigned long nibble = std::strtoul(digit, &end, 16);
+    mask <<= 4u;
+    value <<= 4u;
+    if (*end == 0) {
+      mask |= 0xFu;
+      value |= nibble;
+    } else if (text[i] != '.') {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParseRange(char const *text, uint16_t &first, uint16_t &last) {
+  char *end;
+  first = std::strtoul(text, &end, 16);
+  last = first;
+  if (*end == '-') {
+    last = std::strtoul(end + 1, &end, 16);
+  }
+  return *end == 0 && first <= last;
+}
+
+void Usage(char const *program) {
+  std::cerr << "Usage: " << program
+            << " <Trace> [--from N] [--count N] [--pc ADDR[-ADDR]]"
+               " [--match PATTERN] [--summary]\n"
+               "PATTERN is four hex digits, '.' matching any, such as D...\n";
+  std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+// Prints the instructions in a trace written with --trace, numbered from
+// the first, optionally filtered by position, address and opcode, or a
+// count of each instruction instead
+int main(int argc, char **argv) {
+  char const *filename = nullptr;
+  uint64_t from = 0;
+  uint64_t count = UINT64_MAX;
+  uint16_t firstPc = 0;
+  uint16_t lastPc = 0xFFFF;
+  uint16_t mask = 0;
+  uint16_t value = 0;
+  bool summary = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+      from = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+      count = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--pc") == 0 && i + 1 < argc) {
+      if (!ParseRange(argv[++i], firstPc, lastPc)) {
+        Usage(argv[0]);
+      }
+    } else if (std::strcmp(argv[i], "--match") == 0 && i + 1 < argc) {
+      if (!ParsePattern(argv[++i], mask, value)) {
+        Usage(argv[0]);
+      }
+    } else if (std::strcmp(argv[i], "--summary") == 0) {
+      summary = true;
+    } else if (argv[i][0] == '-' || filename) {
+      Usage(argv[0]);
+    } else {
+      filename = argv[i];
+    }
+  }
+
+  if (!filename) {
+    Usage(argv[0]);
+  }
+
+  TraceReader trace;
+  std::string error;
+  if (!trace.Open(filename, error)) {
+    std::cerr << error << "\n";
+    return EXIT_FAILURE;
+  }
+
+  std::map<std::string, uint64_t> counts;
+  uint64_t shown = 0;
+  uint64_t total = 0;
+  TraceRecord record;
+
+  for (uint64_t number = 0; shown < count && trace.Next(record); ++number) {
+    total = number + 1;
+    if (number < from || record.pc < firstPc || record.pc > lastPc ||
+        (record.opcode & mask) != value) {
+      continue;
+    }
+    ++shown;
+
+    std::string text = Disassemble(record.opcode);
+    if (summary) {
+      ++counts[text.substr(0, text.find(' '))];
+      continue;
+    }
+
+    unsigned int x = (record.opcode >> 8u) & 0xFu;
+    std::printf("%10" PRIu64 "  %03X  %04X  %-18s I=%04X V%X=%02X VF=%02X\n",
+                number, record.pc, record.opcode, text.c_str(),
+                record.index, x, record.vx, record.vf);
+  }
+
+  if (summary) {
+    std::printf("%s trace, %" PRIu64 " of %" PRIu64 " instructions\n",
+                VariantName(trace.GetVariant()), shown, total);
+    for (auto const &entry : counts) {
+      std::printf("%-6s %12" PRIu64 " %5.1f%%\n", entry.first.c_str(),
+                  entry.second, shown ? 100.0 * entry.second / shown : 0.0);
+    }
+  }
+
+  if (trace.Failed()) {
+    std::cerr << filename << " is truncated or corrupt after instruction "
+              << total << "\n";
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
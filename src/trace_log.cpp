@@ -0,0 +1,285 @@
+#include "../headers/trace_log.h"
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+char const MAGIC[4] = {'C', '8', 'T', 'R'};
+const uint32_t VERSION = 1;
+// Room for about a second of emulation at full speed
+const size_t RING_RECORDS = 1u << 20u;
+const size_t CHUNK_RECORDS = 1u << 16u;
+const auto IDLE_WAIT = std::chrono::milliseconds(1);
+
+template <typename T> bool Write(std::FILE *file, T value) {
+  return std::fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+template <typename T> bool Read(std::FILE *file, T &value) {
+  return std::fread(&value, sizeof(value), 1, file) == 1;
+}
+
+// Each record is a mask byte and the bytes it marks, or a zero byte and
+// a count of records predicted exactly
+size_t MaxEncodedSize(size_t records) {
+  return records * (1 + sizeof(TraceRecord));
+}
+
+uint8_t *WriteVarint(uint8_t *out, size_t value) {
+  while (value >= 0x80) {
+    *out++ = value | 0x80u;
+    value >>= 7u;
+  }
+  *out++ = value;
+  return out;
+}
+
+// Null if the varint runs past the end
+uint8_t const *ReadVarint(uint8_t const *in, uint8_t const *end,
+                          size_t &value) {
+  value = 0;
+  for (unsigned int shift = 0; in < end && shift < 64; shift += 7) {
+    uint8_t byte = *in++;
+    value |= size_t(byte & 0x7Fu) << shift;
+    if (!(byte & 0x80u)) {
+      return in;
+    }
+  }
+  return nullptr;
+}
+
+// Sets the top bit of each nonzero byte, and then gathers those bits
+const uint64_t LOW_BITS = 0x7F7F7F7F7F7F7F7Full;
+const uint64_t GATHER_BITS = 0x0002040810204081ull;
+
+unsigned int LowestBit(uint64_t value) {
+#ifdef __GNUC__
+  return __builtin_ctzll(value);
+#else
+  unsigned int bit = 0;
+  for (; !(value & 1u); value >>= 1u) {
+    ++bit;
+  }
+  return bit;
+#endif
+}
+
+uint64_t Bits(TraceRecord const &record) {
+  uint64_t bits;
+  std::memcpy(&bits, &record, sizeof(bits));
+  return bits;
+}
+
+} // namespace
+
+// Little-endian: magic, version, variant, then chunks of (record count,
+// encoded size, encoded records)
+TraceWriter::TraceWriter() : ring(RING_RECORDS) {}
+
+TraceWriter::~TraceWriter() { Close(); }
+
+bool TraceWriter::Open(char const *filename, Variant variant,
+                       std::string &error) {
+  file = std::fopen(filename, "wb");
+  if (!file) {
+    error = std::string("Could not write ") + filename;
+    return false;
+  }
+
+  if (!(std::fwrite(MAGIC, sizeof(MAGIC), 1, file) == 1 &&
+        Write(file, VERSION) && Write(file, uint32_t(variant)))) {
+    error = std::string("Could not write ") + filename;
+    std::fclose(file);
+    file = nullptr;
+    return false;
+  }
+
+  chunk.resize(CHUNK_RECORDS);
+  encoded.resize(MaxEncodedSize(CHUNK_RECORDS));
+
+  open = true;
+  thread = std::thread(&TraceWriter::Drain, this);
+  return true;
+}
+
+bool TraceWriter::Close() {
+  if (!file) {
+    return true;
+  }
+
+  Submit();
+  open = false;
+  thread.join();
+
+  bool written = !failed && std::fclose(file) == 0;
+  file = nullptr;
+  return written;
+}
+
+void TraceWriter::Submit() {
+  size_t done = 0;
+  while (done < used) {
+    done += ring.Push(batch + done, used - done);
+    if (done < used) {
+      std::this_thread::yield();
+    }
+  }
+
+  records += used;
+  used = 0;
+}
+
+void TraceWriter::Drain() {
+  while (true) {
+    // Read the flag first, so nothing pushed before Close() is missed
+    bool closing = !open.load(std::memory_order_acquire);
+    size_t count = ring.Pop(chunk.data(), CHUNK_RECORDS);
+
+    if (count > 0) {
+      failed = !WriteChunk(count) || failed;
+    } else if (closing) {
+      return;
+    } else {
+      std::this_thread::sleep_for(IDLE_WAIT);
+    }
+  }
+}
+
+bool TraceWriter::WriteChunk(size_t count) {
+  // Locals, as every byte written could otherwise alias the members
+  TraceRecord const *records = chunk.data();
+  uint16_t previous = previousPc;
+  uint8_t *out = encoded.data();
+  size_t predicted = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    TraceRecord &successor = successors[previous & (CODE_MEMORY - 1u)];
+    uint64_t diff = Bits(records[i]) ^ Bits(successor);
+    successor = records[i];
+    previous = records[i].pc;
+
+    if (diff == 0) {
+      ++predicted;
+      continue;
+    }
+    if (predicted > 0) {
+      *out++ = 0;
+      out = WriteVarint(out, predicted);
+      predicted = 0;
+    }
+
+    // Bit n of the mask is set when byte n differs. A loop testing each
+    // byte in turn mispredicts often enough to double the cost.
+    uint64_t nonzero = (((diff & LOW_BITS) + LOW_BITS) | diff) & ~LOW_BITS;
+    *out++ = (nonzero * GATHER_BITS) >> 56u;
+    for (; nonzero != 0; nonzero &= nonzero - 1) {
+      *out++ = diff >> (LowestBit(nonzero) - 7);
+    }
+  }
+  if (predicted > 0) {
+    *out++ = 0;
+    out = WriteVarint(out, predicted);
+  }
+  previousPc = previous;
+
+  size_t size = out - encoded.data();
+  return Write(file, uint32_t(count)) && Write(file, uint32_t(size)) &&
+         std::fwrite(encoded.data(), 1, size, file) == size;
+}
+
+TraceReader::~TraceReader() {
+  if (file) {
+    std::fclose(file);
+  }
+}
+
+bool TraceReader::Open(char const *filename, std::string &error) {
+  file = std::fopen(filename, "rb");
+  if (!file) {
+    error = std::string("Could not read ") + filename;
+    return false;
+  }
+
+  char magic[sizeof(MAGIC)];
+  uint32_t version;
+  uint32_t variantId;
+  if (std::fread(magic, sizeof(magic), 1, file) != 1 ||
+      memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || !Read(file, version) ||
+      version != VERSION || !Read(file, variantId) ||
+      variantId > uint32_t(Variant::XoChip)) {
+    error = std::string(filename) + " is not a trace";
+    return false;
+  }
+
+  variant = Variant(variantId);
+  return true;
+}
+
+bool TraceReader::Next(TraceRecord &record) {
+  if (position == chunk.size() && !ReadChunk()) {
+    return false;
+  }
+  record = chunk[position++];
+  return true;
+}
+
+bool TraceReader::ReadChunk() {
+  uint32_t count;
+  uint32_t size;
+  if (!Read(file, count)) {
+    // A clean end of the trace
+    return false;
+  }
+  if (!Read(file, size) || count == 0 || count > CHUNK_RECORDS ||
+      size > MaxEncodedSize(count)) {
+    failed = true;
+    return false;
+  }
+
+  encoded.resize(size);
+  if (std::fread(encoded.data(), 1, size, file) != size) {
+    failed = true;
+    return false;
+  }
+
+  chunk.resize(count);
+  uint8_t const *in = encoded.data();
+  uint8_t const *end = in + size;
+  size_t predicted = 0;
+
+  for (TraceRecord &record : chunk) {
+    uint64_t diff = 0;
+    if (predicted > 0) {
+      --predicted;
+    } else if (in == end) {
+      failed = true;
+      return false;
+    } else if (uint8_t mask = *in++) {
+      for (unsigned int n = 0; n < 8; ++n) {
+        if ((mask & (1u << n)) && in < end) {
+          diff |= uint64_t(*in++) << (8u * n);
+        }
+      }
+    } else {
+      in = ReadVarint(in, end, predicted);
+      if (!in || predicted == 0) {
+        failed = true;
+        return false;
+      }
+      --predicted;
+    }
+
+    TraceRecord &successor = successors[previousPc & (CODE_MEMORY - 1u)];
+    uint64_t bits = Bits(successor) ^ diff;
+    std::memcpy(&record, &bits, sizeof(record));
+    successor = record;
+    previousPc = record.pc;
+  }
+
+  if (predicted > 0 || in != end) {
+    failed = true;
+    return false;
+  }
+  position = 0;
+  return true;
+}
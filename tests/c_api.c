@@ -0,0 +1,172 @@
+#include "../headers/chip8_c.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Clears the screen, draws a sprite, waits for a key and then faults on an
+// opcode no CHIP-8 has, before spinning in place
+static uint8_t const rom[] = {0x00, 0xE0, 0xA2, 0x0C, 0xD0, 0x15,
+                              0xF0, 0x0A, 0x01, 0x23, 0x12, 0x0A,
+                              0xF0, 0x90, 0x90, 0x90, 0xF0};
+
+static int failures;
+
+static void Expect(char const *engine, char const *what, int ok) {
+  if (!ok) {
+    printf("FAIL %s: %s\n", engine, what);
+    ++failures;
+  }
+}
+
+static void Run(int engine, char const *name) {
+  static uint32_t video[CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT];
+  uint32_t left = 0;
+  uint16_t address = 0;
+  chip8 *machine = chip8_create(1, CHIP8_VARIANT_COSMAC_VIP);
+
+  Expect(name, "create", machine != NULL);
+  if (!machine) {
+    return;
+  }
+  Expect(name, "engine", chip8_set_engine(machine, engine));
+  Expect(name, "load", chip8_load_rom(machine, rom, sizeof(rom)));
+  chip8_set_stop_on_draw(machine, 1);
+  chip8_set_stop_on_fault(machine, 1);
+
+  Expect(name, "stop after clearing",
+         chip8_run_cycles(machine, 100, &left) == CHIP8_STOP_DRAW &&
+             left == 99);
+  Expect(name, "stop after drawing",
+         chip8_run_cycles(machine, left, &left) == CHIP8_STOP_DRAW &&
+             left == 97);
+  Expect(name, "wait for a key",
+         chip8_run_cycles(machine, left, &left) == CHIP8_STOP_KEY_WAIT &&
+             left == 0);
+
+  chip8_set_keypad(machine, 1u << 5u);
+  Expect(name, "stop at the fault",
+         chip8_run_cycles(machine, 100, &left) == CHIP8_STOP_FAULT &&
+             left == 98);
+  Expect(name, "fault address",
+         chip8_fault(machine, &address) == CHIP8_FAULT_INVALID_OPCODE &&
+             address == 0x208);
+  Expect(name, "run the budget",
+         chip8_run_cycles(machine, 50, &left) == CHIP8_STOP_BUDGET &&
+             left == 0);
+
+  chip8_video(machine, video);
+  Expect(name, "video",
+         video[0] != video[CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT - 1]);
+
+  size_t size = chip8_state_size();
+  void *state = malloc(size);
+  uint64_t hash = chip8_state_hash(machine);
+  Expect(name, "save", chip8_save_state(machine, state, size));
+  chip8_run_frame(machine, 15, NULL);
+  Expect(name, "load", chip8_load_state(machine, state, size) &&
+                           chip8_state_hash(machine) == hash);
+  Expect(name, "state size", !chip8_load_state(machine, state, size - 1));
+  free(state);
+
+  chip8_destroy(machine);
+}
+
+static void Debug(int engine, char const *name) {
+  uint32_t left = 0;
+  uint16_t pc = 0;
+  uint16_t address = 0;
+  int access = 0;
+  chip8 *machine = chip8_create(1, CHIP8_VARIANT_COSMAC_VIP);
+
+  Expect(name, "create", machine != NULL);
+  if (!machine) {
+    return;
+  }
+  chip8_set_engine(machine, engine);
+  chip8_load_rom(machine, rom, sizeof(rom));
+  chip8_set_breakpoint(machine, 0x204, 1);
+  chip8_set_watchpoint(machine, 0x20E, 1, CHIP8_ACCESS_READ, 1);
+
+  Expect(name, "stop at the breakpoint",
+         chip8_run_cycles(machine, 100, &left) == CHIP8_STOP_BREAKPOINT &&
+             left == 98);
+  Expect(name, "breakpoint address",
+         chip8_last_break(machine, &pc, NULL, NULL) ==
+                 CHIP8_STOP_BREAKPOINT &&
+             pc == 0x204);
+  Expect(name, "stop at the watchpoint",
+         chip8_run_cycles(machine, left, &left) == CHIP8_STOP_WATCHPOINT &&
+             left == 98);
+  Expect(name, "watchpoint address",
+         chip8_last_break(machine, &pc, &address, &access) ==
+                 CHIP8_STOP_WATCHPOINT &&
+             pc == 0x204 && address == 0x20E &&
+             access == CHIP8_ACCESS_READ);
+  Expect(name, "resume past both",
+         chip8_run_cycles(machine, left, &left) == CHIP8_STOP_KEY_WAIT);
+
+  chip8_clear_breakpoints(machine);
+  chip8_set_opcode_breakpoint(machine, 0xF00A, 0xF0FF, 1);
+  Expect(name, "stop at the opcode",
+         chip8_run_cycles(machine, 10, &left) == CHIP8_STOP_BREAKPOINT &&
+             left == 10);
+  chip8_destroy(machine);
+}
+
+// XO-CHIP stores V0 and V1 at 300 with 5012, loads them back in reverse
+// with 5103, then spins in place
+static uint8_t const xoRom[] = {0xA3, 0x00, 0x50, 0x12, 0x51, 0x03,
+                                0x12, 0x06};
+
+static void Ranges(int engine, char const *name) {
+  uint32_t left = 0;
+  uint16_t pc = 0;
+  uint16_t address = 0;
+  int access = 0;
+  chip8 *machine = chip8_create(1, CHIP8_VARIANT_XO_CHIP);
+
+  Expect(name, "create", machine != NULL);
+  if (!machine) {
+    return;
+  }
+  chip8_set_engine(machine, engine);
+  chip8_load_rom(machine, xoRom, sizeof(xoRom));
+  chip8_set_watchpoint(machine, 0x301, 1, CHIP8_ACCESS_WRITE, 1);
+  chip8_set_watchpoint(machine, 0x300, 1, CHIP8_ACCESS_READ, 1);
+
+  Expect(name, "stop at the range store",
+         chip8_run_cycles(machine, 100, &left) == CHIP8_STOP_WATCHPOINT &&
+             left == 99);
+  Expect(name, "range store address",
+         chip8_last_break(machine, &pc, &address, &access) ==
+                 CHIP8_STOP_WATCHPOINT &&
+             pc == 0x202 && address == 0x301 &&
+             access == CHIP8_ACCESS_WRITE);
+  Expect(name, "stop at the range load",
+         chip8_run_cycles(machine, left, &left) == CHIP8_STOP_WATCHPOINT &&
+             left == 98);
+  Expect(name, "range load address",
+         chip8_last_break(machine, &pc, &address, &access) ==
+                 CHIP8_STOP_WATCHPOINT &&
+             pc == 0x204 && address == 0x300 &&
+             access == CHIP8_ACCESS_READ);
+  Expect(name, "resume past the loads",
+         chip8_run_cycles(machine, left, &left) == CHIP8_STOP_BUDGET);
+  chip8_destroy(machine);
+}
+
+// Drives the shared library through its C interface only
+int main(void) {
+  if (chip8_api_version() < CHIP8_API_VERSION) {
+    printf("FAIL library API version %u, built against %u\n",
+           (unsigned int)chip8_api_version(), CHIP8_API_VERSION);
+    return EXIT_FAILURE;
+  }
+  Run(CHIP8_ENGINE_INTERPRETER, "interpreter");
+  Run(CHIP8_ENGINE_RECOMPILER, "recompiler");
+  Debug(CHIP8_ENGINE_INTERPRETER, "interpreter");
+  Debug(CHIP8_ENGINE_RECOMPILER, "recompiler");
+  Ranges(CHIP8_ENGINE_INTERPRETER, "interpreter");
+  Ranges(CHIP8_ENGINE_RECOMPILER, "recompiler");
+  printf("C API: %s\n", failures ? "FAILED" : "passed");
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
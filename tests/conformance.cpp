@@ -0,0 +1,1427 @@
+#include "../headers/batch.h"
+#include "../headers/breakpoints.h"
+#include "../headers/chip8.h"
+#include "../headers/disassembler.h"
+#include "../headers/explorer.h"
+#include "../headers/hash.h"
+#include "../headers/input_log.h"
+#include "../headers/rewind.h"
+#include "../headers/rom_database.h"
+#include "../headers/thread_pool.h"
+#include "../headers/trace_log.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint32_t DEFAULT_SPEED = 15;
+const uint32_t DEFAULT_FRAMES = 300;
+const uint32_t DEFAULT_EVERY = 60;
+const uint32_t DEFAULT_SEED = 1;
+const uint64_t DEFAULT_CYCLES = 5000000;
+const double DEFAULT_THRESHOLD = 0.25;
+const unsigned int THROUGHPUT_ROUNDS = 5;
+// Differing memory bytes listed when two states are dumped
+const unsigned int DUMP_BYTES = 8;
+// Random buffer pairs the XOR-RLE codec is checked on, and their size
+const unsigned int CODEC_ROUNDS = 256;
+const size_t CODEC_BYTES = 4096;
+// Rewind buffers in the unit checks hold this many worst-case snapshots,
+// and memory bytes scribbled over in each, so every corpus run drops
+// keyframe groups
+const size_t REWIND_SNAPSHOTS = 3;
+const unsigned int REWIND_KEYFRAMES = 4;
+const size_t REWIND_SCRIBBLE = 8192;
+// States each corpus ROM is explored to, and threads to compare one
+// against
+const size_t EXPLORE_STATES = 1000;
+const unsigned int EXPLORE_THREADS = 4;
+// Instances in each batch the unit checks step
+const size_t BATCH_INSTANCES = 4;
+
+Engine const engines[] = {Engine::Interpreter, Engine::Recompiler};
+Dispatch const dispatches[] = {Dispatch::Cached, Dispatch::Switch,
+                               Dispatch::Threaded, Dispatch::Table};
+
+char const *EngineName(Engine engine) {
+  return engine == Engine::Recompiler ? "recompiler" : "interpreter";
+}
+
+// How a ROM is run, read from the <name>.test next to it:
+//   variants chip8 schip   dialects to run under, each with its own goldens
+//   speed 15               instructions per frame
+//   frames 300             frames to run
+//   every 60               frames between checkpoints
+//   seed 1                 random number generator seed
+//   keys 120 0010          keypad mask in hex held from frame 120 on
+struct Script {
+  std::vector<Variant> variants;
+  uint32_t speed{DEFAULT_SPEED};
+  uint32_t frames{DEFAULT_FRAMES};
+  uint32_t every{DEFAULT_EVERY};
+  uint32_t seed{DEFAULT_SEED};
+  InputLog input;
+};
+
+struct Rom {
+  std::string name;
+  std::filesystem::path path;
+  std::vector<uint8_t> data;
+  Script script;
+};
+
+struct Checkpoint {
+  Variant variant;
+  uint32_t frame;
+  uint64_t state;
+  uint64_t display;
+
+  bool operator==(Checkpoint const &other) const {
+    return variant == other.variant && frame == other.frame &&
+           state == other.state && display == other.display;
+  }
+};
+
+// One ROM run under one dialect with one engine, and for the interpreter
+// one dispatch
+struct Job {
+  Rom *rom;
+  Variant variant;
+  Engine engine;
+  Dispatch dispatch;
+  std::vector<Checkpoint> checkpoints;
+  double rate{};
+  // Where a lockstep run left the reference, empty if it never did
+  std::string divergence;
+  // Hash of the reason, cycles left and CPU of every stop a run with stops
+  // on made within a frame
+  uint64_t stops{};
+};
+
+bool ReadFile(std::filesystem::path const &path, std::vector<uint8_t> &data) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  data.assign(std::istreambuf_iterator<char>(file),
+              std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool WriteFile(std::filesystem::path const &path,
+               std::vector<uint8_t> const &data) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<char const *>(data.data()), data.size());
+  return bool(file);
+}
+
+bool ParseScript(std::filesystem::path const &path, Script &script) {
+  std::ifstream file(path);
+  std::string line;
+  unsigned int number = 0;
+
+  while (std::getline(file, line)) {
+    ++number;
+    std::istringstream words(line.substr(0, line.find('#')));
+    std::string directive;
+    if (!(words >> directive)) {
+      continue;
+    }
+
+    bool valid = true;
+    if (directive == "variants") {
+      std::string name;
+      while (valid && words >> name) {
+        Variant variant;
+        valid = ParseVariant(name.c_str(), variant);
+        script.variants.push_back(variant);
+      }
+    } else if (directive == "speed") {
+      valid = bool(words >> script.speed);
+    } else if (directive == "frames") {
+      valid = bool(words >> script.frames);
+    } else if (directive == "every") {
+      valid = bool(words >> script.every) && script.every > 0;
+    } else if (directive == "seed") {
+      valid = bool(words >> script.seed);
+    } else if (directive == "keys") {
+      uint32_t frame;
+      uint32_t keys;
+      valid = bool(words >> frame >> std::hex >> keys) && keys <= 0xFFFF;
+      if (valid) {
+        script.input.Record(frame, keys);
+      }
+    } else {
+      valid = false;
+    }
+
+    if (!valid) {
+      std::cerr << path.string() << ":" << number << ": cannot parse \""
+                << line << "\"\n";
+      return false;
+    }
+  }
+
+  if (script.variants.empty()) {
+    script.variants.push_back(Variant::CosmacVip);
+  }
+  return true;
+}
+
+// Every *.ch8 in `directory`, sorted by name so output is stable
+bool LoadCorpus(std::filesystem::path const &directory,
+                std::vector<Rom> &roms) {
+  std::error_code error;
+  for (auto const &entry :
+       std::filesystem::directory_iterator(directory, error)) {
+    if (entry.path().extension() != ".ch8") {
+      continue;
+    }
+
+    Rom rom;
+    rom.name = entry.path().stem().string();
+    rom.path = entry.path();
+    if (!ReadFile(rom.path, rom.data)) {
+      std::cerr << "Could not read " << rom.path.string() << "\n";
+      return false;
+    }
+
+    std::filesystem::path script = rom.path;
+    script.replace_extension(".test");
+    if (std::filesystem::exists(script) &&
+        !ParseScript(script, rom.script)) {
+      return false;
+    }
+    roms.push_back(std::move(rom));
+  }
+
+  if (error) {
+    std::cerr << "Could not list " << directory.string() << ": "
+              << error.message() << "\n";
+    return false;
+  }
+
+  std::sort(roms.begin(), roms.end(),
+            [](Rom const &a, Rom const &b) { return a.name < b.name; });
+  return true;
+}
+
+Checkpoint Capture(Chip8 const &chip8, Variant variant, uint32_t frame) {
+  return {variant, frame, chip8.StateHash(),
+          Hash64(chip8.display, sizeof(Display), chip8.HiRes())};
+}
+
+// Checkpoints after loading, every `every` frames and after the last frame.
+// With `stops`, every draw and fault stops the run, and with `checked` a
+// breakpoint on every draw and a watchpoint on every store. Each frame then
+// takes as many RunFrame() calls as it has stops, which must not change
+// the result.
+void RunScript(Job &job, bool stops, bool checked) {
+  Script &script = job.rom->script;
+  Chip8 chip8(script.seed, job.variant);
+  chip8.SetEngine(job.engine);
+  chip8.SetDispatch(job.dispatch);
+  chip8.SetStopOnDraw(stops);
+  chip8.SetStopOnFault(stops);
+  std::unique_ptr<Breakpoints> breakpoints;
+  if (checked) {
+    breakpoints = std::make_unique<Breakpoints>();
+    breakpoints->SetOpcodeBreakpoint(0xD000, 0xF000);
+    breakpoints->SetWatchpoint(0, MEMORY, Breakpoints::Access::Write);
+    chip8.SetBreakpoints(breakpoints.get());
+  }
+  chip8.LoadROM(job.rom->data.data(), job.rom->data.size());
+  job.checkpoints.push_back(Capture(chip8, job.variant, 0));
+
+  InputLog input = script.input;
+  for (uint32_t frame = 0; frame < script.frames; ++frame) {
+    chip8.SetKeypad(input.KeysAt(frame));
+    StopReason reason = chip8.RunFrame(script.speed);
+    while (chip8.CyclesLeft() > 0) {
+      uint64_t stop[3] = {uint64_t(reason), chip8.CyclesLeft(),
+                          chip8.CpuHash()};
+      job.stops = Hash64(stop, sizeof(stop), job.stops);
+      reason = chip8.RunFrame(script.speed);
+    }
+
+    uint32_t done = frame + 1;
+    if (done % script.every == 0 || done == script.frames) {
+      job.checkpoints.push_back(Capture(chip8, job.variant, done));
+    }
+  }
+}
+
+// One timed run; the best of several is kept, as a busy machine only ever
+// makes a run slower
+void MeasureThroughput(Job &job, uint64_t cycles) {
+  Chip8 chip8(job.rom->script.seed, job.variant);
+  chip8.SetEngine(job.engine);
+  chip8.SetDispatch(job.dispatch);
+  chip8.SetSkipIdle(false);
+  chip8.LoadROM(job.rom->data.data(), job.rom->data.size());
+
+  auto start = std::chrono::steady_clock::now();
+  chip8.RunCycles(cycles);
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  job.rate = std::max(job.rate, seconds > 0 ? cycles / seconds : 0.0);
+}
+
+// Golden files hold one "variant frame state display" line per checkpoint
+bool ReadGolden(std::filesystem::path const &path,
+                std::vector<Checkpoint> &golden) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream words(line.substr(0, line.find('#')));
+    std::string name;
+    Checkpoint checkpoint;
+    if (!(words >> name)) {
+      continue;
+    }
+    if (!ParseVariant(name.c_str(), checkpoint.variant) ||
+        !(words >> checkpoint.frame >> std::hex >> checkpoint.state >>
+          checkpoint.display)) {
+      std::cerr << path.string() << ": cannot parse \"" << line << "\"\n";
+      return false;
+    }
+    golden.push_back(checkpoint);
+  }
+  return true;
+}
+
+bool WriteGolden(std::filesystem::path const &path,
+                 std::vector<Checkpoint> const &checkpoints) {
+  std::FILE *file = std::fopen(path.string().c_str(), "w");
+  if (!file) {
+    return false;
+  }
+
+  std::fprintf(file, "# variant frame state-hash display-hash\n");
+  for (Checkpoint const &checkpoint : checkpoints) {
+    std::fprintf(file, "%s %" PRIu32 " %016" PRIx64 " %016" PRIx64 "\n",
+                 VariantName(checkpoint.variant), checkpoint.frame,
+                 checkpoint.state, checkpoint.display);
+  }
+  return std::fclose(file) == 0;
+}
+
+std::string EngineLabel(Job const &job) {
+  std::string engine = EngineName(job.engine);
+  if (job.engine == Engine::Interpreter) {
+    engine += std::string("/") + DispatchName(job.dispatch);
+  }
+  return engine;
+}
+
+// Compares one job against the goldens and reports the first divergence
+bool Matches(Job const &job, std::vector<Checkpoint> const &golden) {
+  std::vector<Checkpoint> expected;
+  for (Checkpoint const &checkpoint : golden) {
+    if (checkpoint.variant == job.variant) {
+      expected.push_back(checkpoint);
+    }
+  }
+
+  char const *label = VariantName(job.variant);
+  std::string engine = EngineLabel(job);
+
+  if (expected.size() != job.checkpoints.size()) {
+    std::printf("FAIL %s %s %s: %zu checkpoints, golden has %zu\n",
+                job.rom->name.c_str(), label, engine.c_str(),
+                job.checkpoints.size(), expected.size());
+    return false;
+  }
+
+  for (size_t i = 0; i < expected.size(); ++i) {
+    Checkpoint const &actual = job.checkpoints[i];
+    if (!(actual == expected[i])) {
+      std::printf("FAIL %s %s %s: frame %" PRIu32 " state %016" PRIx64
+                  " display %016" PRIx64 ", expected frame %" PRIu32
+                  " state %016" PRIx64 " display %016" PRIx64 "\n",
+                  job.rom->name.c_str(), label, engine.c_str(), actual.frame,
+                  actual.state, actual.display,
+                  expected[i].frame, expected[i].state, expected[i].display);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CheckConformance(std::vector<Rom> &roms, std::vector<Job> &jobs,
+                      bool update) {
+  bool passed = true;
+
+  for (Rom &rom : roms) {
+    std::filesystem::path goldenPath = rom.path;
+    goldenPath.replace_extension(".golden");
+
+    std::vector<Checkpoint> golden;
+    if (update) {
+      // Goldens come from the interpreter's cached dispatch; the other
+      // dispatches and the recompiler must agree
+      for (Job const &job : jobs) {
+        if (job.rom == &rom && job.engine == Engine::Interpreter &&
+            job.dispatch == Dispatch::Cached) {
+          golden.insert(golden.end(), job.checkpoints.begin(),
+                        job.checkpoints.end());
+        }
+      }
+      if (!WriteGolden(goldenPath, golden)) {
+        std::printf("FAIL %s: could not write %s\n", rom.name.c_str(),
+                    goldenPath.string().c_str());
+        passed = false;
+        continue;
+      }
+    } else if (!ReadGolden(goldenPath, golden)) {
+      std::printf("FAIL %s: no golden hashes, run with --update\n",
+                  rom.name.c_str());
+      passed = false;
+      continue;
+    }
+
+    for (Job const &job : jobs) {
+      if (job.rom == &rom) {
+        passed = Matches(job, golden) && passed;
+      }
+    }
+  }
+  return passed;
+}
+
+// Every engine and dispatch has to stop where the reference interpreter
+// does, as hosts rely on stops landing on the same instruction
+bool CheckStops(std::vector<Job> const &jobs) {
+  bool passed = true;
+  for (Job const &job : jobs) {
+    for (Job const &reference : jobs) {
+      if (reference.rom == job.rom && reference.variant == job.variant &&
+          reference.engine == Engine::Interpreter &&
+          reference.dispatch == Dispatch::Cached &&
+          reference.stops != job.stops) {
+        std::printf("FAIL %s %s %s: stops differ from the reference\n",
+                    job.rom->name.c_str(), VariantName(job.variant),
+                    EngineLabel(job).c_str());
+        passed = false;
+      }
+    }
+  }
+  return passed;
+}
+
+// Appends "name reference candidate" when the two differ
+void DumpField(std::string &out, char const *name, unsigned int expected,
+               unsigned int actual) {
+  if (expected != actual) {
+    char line[64];
+    std::snprintf(line, sizeof(line), "    %-14s %8X %8X\n", name, expected,
+                  actual);
+    out += line;
+  }
+}
+
+// The fields of two states that differ, side by side
+std::string DumpStates(Chip8State const &expected, Chip8State const &actual) {
+  std::string out = "    field          reference candidate\n";
+  char name[32];
+
+  DumpField(out, "pc", expected.pc, actual.pc);
+  DumpField(out, "I", expected.index, actual.index);
+  for (unsigned int i = 0; i < REGISTERS; ++i) {
+    std::snprintf(name, sizeof(name), "V%X", i);
+    DumpField(out, name, expected.registers[i], actual.registers[i]);
+  }
+  DumpField(out, "sp", expected.sp, actual.sp);
+  for (unsigned int i = 0; i < STACK; ++i) {
+    std::snprintf(name, sizeof(name), "stack[%u]", i);
+    DumpField(out, name, expected.stack[i], actual.stack[i]);
+  }
+  DumpField(out, "delay timer", expected.delayTimer, actual.delayTimer);
+  DumpField(out, "sound timer", expected.soundTimer, actual.soundTimer);
+  DumpField(out, "hires", expected.hires, actual.hires);
+  DumpField(out, "planes", expected.planes, actual.planes);
+  DumpField(out, "pitch", expected.pitch, actual.pitch);
+  DumpField(out, "rng", expected.rngState, actual.rngState);
+  for (unsigned int i = 0; i < REGISTERS; ++i) {
+    std::snprintf(name, sizeof(name), "flag R%X", i);
+    DumpField(out, name, expected.flags[i], actual.flags[i]);
+  }
+  for (unsigned int i = 0; i < AUDIO_PATTERN; ++i) {
+    std::snprintf(name, sizeof(name), "pattern[%u]", i);
+    DumpField(out, name, expected.audioPattern[i], actual.audioPattern[i]);
+  }
+
+  unsigned int bytes = 0;
+  for (unsigned int i = 0; i < MEMORY; ++i) {
+    if (expected.memory[i] != actual.memory[i] && bytes++ < DUMP_BYTES) {
+      std::snprintf(name, sizeof(name), "memory[%04X]", i);
+      DumpField(out, name, expected.memory[i], actual.memory[i]);
+    }
+  }
+  if (bytes > DUMP_BYTES) {
+    out += "    and " + std::to_string(bytes - DUMP_BYTES) +
+           " more memory bytes\n";
+  }
+
+  unsigned int rows = 0;
+  for (unsigned int plane = 0; plane < PLANES; ++plane) {
+    for (unsigned int row = 0; row < DISPLAY_Height; ++row) {
+      rows += memcmp(expected.display[plane][row], actual.display[plane][row],
+                     sizeof(expected.display[plane][row])) != 0;
+    }
+  }
+  if (rows > 0) {
+    out += "    " + std::to_string(rows) + " display rows\n";
+  }
+  return out;
+}
+
+// Restores `start` and runs `cycles` instructions of a frame from there
+void RunFrom(Chip8 &chip8, Chip8State const &start, uint16_t keys,
+             uint32_t cycles, Chip8State &state) {
+  chip8.LoadState(start);
+  chip8.SetKeypad(keys);
+  if (cycles > 0) {
+    chip8.RunCycles(cycles);
+  }
+  chip8.SaveState(state);
+}
+
+// Both machines agreed at `start` and had come to `diverged` in the frame
+// that followed. Bisects the frame for the first instruction after which
+// they differ and describes both states there.
+std::string Bisect(Chip8 &reference, Chip8 &candidate,
+                   Chip8State const &start, uint16_t keys, uint32_t speed,
+                   uint32_t frame, Chip8State const (&diverged)[2],
+                   Chip8State (&state)[2]) {
+  auto differs = [&](uint32_t cycles) {
+    RunFrom(reference, start, keys, cycles, state[0]);
+    RunFrom(candidate, start, keys, cycles, state[1]);
+    return memcmp(&state[0], &state[1], sizeof(Chip8State)) != 0;
+  };
+
+  char line[160];
+  if (!differs(speed)) {
+    reference.TickTimers();
+    candidate.TickTimers();
+    reference.SaveState(state[0]);
+    candidate.SaveState(state[1]);
+    if (memcmp(&state[0], &state[1], sizeof(Chip8State)) != 0) {
+      std::snprintf(line, sizeof(line),
+                    "diverged ticking the timers after frame %" PRIu32 "\n",
+                    frame);
+      return line + DumpStates(state[0], state[1]);
+    }
+
+    // The candidate depends on something a saved state does not hold
+    std::snprintf(line, sizeof(line),
+                  "diverged in frame %" PRIu32 ", but not when rerun from "
+                  "the state at its start\n",
+                  frame);
+    return line + DumpStates(diverged[0], diverged[1]);
+  }
+
+  uint32_t low = 0;
+  uint32_t high = speed;
+  while (high - low > 1) {
+    uint32_t middle = low + (high - low) / 2;
+    (differs(middle) ? high : low) = middle;
+  }
+
+  differs(low);
+  uint16_t pc = state[0].pc;
+  uint16_t opcode = state[0].memory[pc % MEMORY] << 8u |
+                    state[0].memory[(pc + 1u) % MEMORY];
+  differs(high);
+
+  std::snprintf(line, sizeof(line),
+                "diverged at frame %" PRIu32 " instruction %" PRIu32
+                ": %03X %04X %s\n",
+                frame, high, pc, opcode, Disassemble(opcode).c_str());
+  return line + DumpStates(state[0], state[1]);
+}
+
+// Runs the job beside the reference, the interpreter's cached dispatch,
+// on the same ROM and input. CPU hashes are compared every `interval`
+// instructions and whole states after every frame, so each frame starts
+// from a state both agree on and a difference is bisected within it.
+void RunLockstep(Job &job, uint32_t interval) {
+  Script &script = job.rom->script;
+  Chip8 reference(script.seed, job.variant);
+  Chip8 candidate(script.seed, job.variant);
+  candidate.SetEngine(job.engine);
+  candidate.SetDispatch(job.dispatch);
+  reference.LoadROM(job.rom->data.data(), job.rom->data.size());
+  candidate.LoadROM(job.rom->data.data(), job.rom->data.size());
+
+  // Frame start and end, where the two were found to differ, and scratch
+  // space to bisect in; too large for the stack
+  struct States {
+    Chip8State frame[2];
+    Chip8State diverged[2];
+    Chip8State bisect[2];
+  };
+  std::unique_ptr<States> states = std::make_unique<States>();
+  Chip8State *start = &states->frame[0];
+  Chip8State *end = &states->frame[1];
+  reference.SaveState(*start);
+
+  InputLog input = script.input;
+  for (uint32_t frame = 0; frame < script.frames; ++frame) {
+    uint16_t keys = input.KeysAt(frame);
+    reference.SetKeypad(keys);
+    candidate.SetKeypad(keys);
+
+    bool diverged = false;
+    for (uint32_t done = 0; done < script.speed && !diverged;) {
+      uint32_t slice = std::min(interval, script.speed - done);
+      reference.RunCycles(slice);
+      candidate.RunCycles(slice);
+      done += slice;
+      diverged = reference.CpuHash() != candidate.CpuHash();
+    }
+
+    if (!diverged) {
+      reference.TickTimers();
+      candidate.TickTimers();
+      reference.SaveState(*end);
+      candidate.SaveState(states->diverged[1]);
+      diverged = memcmp(end, &states->diverged[1], sizeof(Chip8State)) != 0;
+    }
+
+    if (diverged) {
+      reference.SaveState(states->diverged[0]);
+      candidate.SaveState(states->diverged[1]);
+      job.divergence = Bisect(reference, candidate, *start, keys,
+                              script.speed, frame, states->diverged,
+                              states->bisect);
+      return;
+    }
+    std::swap(start, end);
+  }
+}
+
+bool CheckLockstep(std::vector<Job> const &jobs) {
+  bool passed = true;
+  for (Job const &job : jobs) {
+    if (!job.divergence.empty()) {
+      std::printf("FAIL %s %s %s: %s", job.rom->name.c_str(),
+                  VariantName(job.variant), EngineLabel(job).c_str(),
+                  job.divergence.c_str());
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+// Random deltas, from none to every byte, have to decode back exactly
+bool CheckCodec() {
+  std::mt19937 random(DEFAULT_SEED);
+  std::vector<uint8_t> a(CODEC_BYTES);
+  std::vector<uint8_t> b(CODEC_BYTES);
+  std::vector<uint8_t> encoded(RewindBuffer::MaxEncodedSize(CODEC_BYTES));
+
+  for (unsigned int round = 0; round < CODEC_ROUNDS; ++round) {
+    size_t size = random() % CODEC_BYTES + 1;
+    unsigned int density = round % 9;
+    for (size_t i = 0; i < size; ++i) {
+      a[i] = random();
+      b[i] = random() % 8 < density ? a[i] ^ (random() % 255 + 1) : a[i];
+    }
+
+    size_t length = RewindBuffer::Encode(a.data(), b.data(), size,
+                                         encoded.data());
+    RewindBuffer::Decode(encoded.data(), length, b.data());
+    if (length > RewindBuffer::MaxEncodedSize(size) ||
+        memcmp(a.data(), b.data(), size) != 0) {
+      std::printf("FAIL rewind: %zu byte delta %u/8 dense does not round "
+                  "trip\n",
+                  size, density);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Stepping a small rewind buffer back through a run, after it has had to
+// drop its oldest keyframe groups, restores each state it kept exactly.
+// Corpus runs barely change between frames, so each snapshot also gets a
+// window of memory scribbled over at random to make the deltas large.
+bool CheckRewind(std::vector<Rom> const &roms) {
+  bool passed = CheckCodec();
+  std::mt19937 random(DEFAULT_SEED);
+  std::unique_ptr<Chip8State> state = std::make_unique<Chip8State>();
+
+  for (Rom const &rom : roms) {
+    Script const &script = rom.script;
+    Chip8 chip8(script.seed, script.variants.front());
+    Chip8 replay(script.seed, script.variants.front());
+    chip8.LoadROM(rom.data.data(), rom.data.size());
+    RewindBuffer rewind(REWIND_SNAPSHOTS *
+                            RewindBuffer::MaxEncodedSize(sizeof(Chip8State)),
+                        REWIND_KEYFRAMES);
+
+    std::vector<uint64_t> hashes;
+    InputLog input = script.input;
+    for (uint32_t frame = 0; frame < script.frames; ++frame) {
+      chip8.SetKeypad(input.KeysAt(frame));
+      chip8.RunFrame(script.speed);
+      chip8.SaveState(*state);
+      size_t first = random() % (MEMORY - REWIND_SCRIBBLE);
+      for (size_t i = first; i < first + REWIND_SCRIBBLE; ++i) {
+        state->memory[i] = random();
+      }
+      rewind.Push(*state);
+      replay.LoadState(*state);
+      hashes.push_back(replay.StateHash());
+    }
+
+    if (rewind.Count() == hashes.size()) {
+      std::printf("FAIL rewind %s: all %zu frames fit, nothing dropped\n",
+                  rom.name.c_str(), hashes.size());
+      passed = false;
+    }
+    for (size_t back = 0; rewind.Pop(*state); ++back) {
+      replay.LoadState(*state);
+      if (replay.StateHash() != hashes[hashes.size() - 1 - back]) {
+        std::printf("FAIL rewind %s: %zu frames back from %zu differs\n",
+                    rom.name.c_str(), back, hashes.size());
+        passed = false;
+        break;
+      }
+    }
+  }
+  return passed;
+}
+
+bool SameSettings(RomSettings const &a, RomSettings const &b) {
+  return a.variant == b.variant &&
+         a.instructionsPerFrame == b.instructionsPerFrame &&
+         memcmp(a.keymap, b.keymap, sizeof(a.keymap)) == 0;
+}
+
+// Whether `database` holds exactly `entries`, each found by its hash and
+// listed in hash order
+bool HoldsEntries(RomDatabase const &database,
+                  std::vector<RomEntry> const &entries) {
+  std::vector<RomEntry> listed = database.Entries();
+  if (listed.size() != entries.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < listed.size(); ++i) {
+    RomSettings settings;
+    if ((i > 0 && listed[i - 1].hash >= listed[i].hash) ||
+        !database.Find(entries[i].hash, settings) ||
+        !SameSettings(settings, entries[i].settings)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Saving, reopening and looking up entries for the corpus ROMs, inserting
+// and removing one, and refusing damaged files
+bool CheckRomDatabase(std::vector<Rom> const &roms) {
+  std::filesystem::path path = std::filesystem::temp_directory_path() /
+                               ("chip8-units-" +
+                                std::to_string(std::random_device()()) +
+                                ".db");
+  std::string error;
+  bool passed = true;
+  auto expect = [&](bool ok, char const *what) {
+    if (!ok) {
+      std::printf("FAIL rom database: %s\n", what);
+      passed = false;
+    }
+  };
+
+  // Saved in reverse name order, which Save() has to sort by hash
+  std::vector<RomEntry> entries;
+  for (auto rom = roms.rbegin(); rom != roms.rend(); ++rom) {
+    RomEntry entry{RomHash(rom->data.data(), rom->data.size()), {}};
+    entry.settings.variant = rom->script.variants.front();
+    entry.settings.instructionsPerFrame = rom->script.speed;
+    for (unsigned int key = 0; key < KEY_COUNT; ++key) {
+      entry.settings.keymap[key] = KEY_COUNT - 1 - key;
+    }
+    entries.push_back(entry);
+  }
+
+  RomDatabase database;
+  RomSettings settings;
+  expect(RomDatabase::Save(path.string().c_str(), entries, error) &&
+             database.Open(path.string().c_str(), error),
+         error.c_str());
+  expect(HoldsEntries(database, entries), "saved entries differ");
+  expect(!database.Find(0, settings), "found a ROM never saved");
+
+  // A new entry and a replacement for the first, which wins over the
+  // entry it repeats
+  RomEntry inserted{RomHash(nullptr, 0), {}};
+  inserted.settings.variant = Variant::XoChip;
+  RomEntry replaced = entries.front();
+  replaced.settings.instructionsPerFrame += 1;
+  std::vector<RomEntry> edited = database.Entries();
+  edited.push_back(inserted);
+  edited.push_back(replaced);
+  entries.front() = replaced;
+  entries.push_back(inserted);
+  expect(RomDatabase::Save(path.string().c_str(), edited, error) &&
+             database.Open(path.string().c_str(), error),
+         error.c_str());
+  expect(HoldsEntries(database, entries), "inserted entries differ");
+
+  uint64_t removed = entries[1].hash;
+  entries.erase(entries.begin() + 1);
+  expect(RomDatabase::Save(path.string().c_str(), entries, error) &&
+             database.Open(path.string().c_str(), error),
+         error.c_str());
+  expect(HoldsEntries(database, entries) && !database.Find(removed, settings),
+         "removed entry differs or is still found");
+
+  std::vector<uint8_t> image;
+  expect(ReadFile(path, image), "cannot read the database back");
+  std::vector<uint8_t> damaged(image.begin(), image.end() - 1);
+  expect(WriteFile(path, damaged) &&
+             !database.Open(path.string().c_str(), error) &&
+             error.find("truncated") != std::string::npos &&
+             database.Count() == 0,
+         "opened a truncated database");
+  damaged.assign(image.begin(), image.end());
+  damaged[0] ^= 0xFF;
+  expect(WriteFile(path, damaged) &&
+             !database.Open(path.string().c_str(), error) &&
+             error.find("not a ROM database") != std::string::npos,
+         "opened a database with a bad header");
+  damaged.assign(image.begin(), image.begin() + 8);
+  expect(WriteFile(path, damaged) &&
+             !database.Open(path.string().c_str(), error),
+         "opened a database shorter than its header");
+  expect(RomDatabase::Save(path.string().c_str(), {}, error) &&
+             database.Open(path.string().c_str(), error) &&
+             database.Count() == 0 && !database.Find(0, settings),
+         "empty database");
+
+  std::filesystem::remove(path);
+  expect(!database.Open(path.string().c_str(), error), "opened no file");
+  return passed;
+}
+
+// Dialects guessed from a few instruction mixes
+bool CheckDetectVariant() {
+  struct Case {
+    char const *name;
+    std::vector<uint8_t> rom;
+    Variant variant;
+  };
+  std::vector<Case> cases = {
+      {"plain CHIP-8", {0x00, 0xE0, 0x60, 0x01, 0x12, 0x02},
+       Variant::CosmacVip},
+      {"one SUPER-CHIP scroll", {0x00, 0xFB, 0x12, 0x00}, Variant::CosmacVip},
+      {"high resolution", {0x00, 0xFF, 0x12, 0x02}, Variant::SuperChip},
+      {"SUPER-CHIP scrolls", {0x00, 0xFB, 0x00, 0xC4}, Variant::SuperChip},
+      {"XO-CHIP ranges", {0x50, 0x12, 0x50, 0x13}, Variant::XoChip},
+      {"odd-aligned XO-CHIP", {0x12, 0x50, 0x12, 0x50, 0x13, 0x00},
+       Variant::CosmacVip},
+      {"larger than 4 KB", std::vector<uint8_t>(CODE_MEMORY), Variant::XoChip},
+  };
+
+  bool passed = true;
+  for (Case const &test : cases) {
+    Variant variant = DetectVariant(test.rom.data(), test.rom.size());
+    if (variant != test.variant) {
+      std::printf("FAIL detect variant: %s is %s, not %s\n", test.name,
+                  VariantName(variant), VariantName(test.variant));
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+// Empty and oversized ROMs are refused, from memory and from files,
+// without touching the machine
+bool CheckLoadRom() {
+  std::filesystem::path path = std::filesystem::temp_directory_path() /
+                               ("chip8-units-" +
+                                std::to_string(std::random_device()()) +
+                                ".ch8");
+  Chip8 chip8(DEFAULT_SEED);
+  uint64_t hash = chip8.StateHash();
+  std::vector<uint8_t> rom(MAX_ROM_SIZE + 1, 0x12);
+  std::string error;
+  bool passed = true;
+  auto expect = [&](bool ok, char const *what) {
+    if (!ok) {
+      std::printf("FAIL load ROM: %s\n", what);
+      passed = false;
+    }
+  };
+
+  expect(!chip8.LoadROM(rom.data(), 0), "loaded an empty ROM");
+  expect(!chip8.LoadROM(rom.data(), rom.size()), "loaded an oversized ROM");
+  expect(chip8.StateHash() == hash, "a refused ROM changed the machine");
+  expect(chip8.LoadROM(rom.data(), MAX_ROM_SIZE), "refused a full ROM");
+
+  expect(WriteFile(path, {}) && !chip8.LoadROM(path.string().c_str(), error) &&
+             error.find("empty") != std::string::npos,
+         "loaded an empty file");
+  expect(WriteFile(path, rom) && !chip8.LoadROM(path.string().c_str(), error) &&
+             error.find(std::to_string(rom.size())) != std::string::npos,
+         "loaded an oversized file");
+  std::filesystem::remove(path);
+  expect(!chip8.LoadROM(path.string().c_str(), error) && !error.empty(),
+         "loaded no file");
+  return passed;
+}
+
+// Ex9E and ExA1 read only the low nibble of Vx as the key, on both engines
+bool CheckKeypad() {
+  // V0 = 0x15; skip V1 = 1 if key 5 is down; skip V2 = 1 if it is up
+  uint8_t const rom[] = {0x60, 0x15, 0xE0, 0x9E, 0x61, 0x01,
+                         0xE0, 0xA1, 0x62, 0x01};
+  std::unique_ptr<Chip8State> state = std::make_unique<Chip8State>();
+  bool passed = true;
+  for (Engine engine : {Engine::Interpreter, Engine::Recompiler}) {
+    Chip8 chip8(DEFAULT_SEED);
+    chip8.SetEngine(engine);
+    chip8.LoadROM(rom, sizeof(rom));
+    chip8.SetKeypad(1u << 5);
+    chip8.RunCycles(4);
+    chip8.SaveState(*state);
+    if (state->registers[1] != 0 || state->registers[2] != 1) {
+      std::printf("FAIL keypad: key 0x15 is not key 5 (%s)\n",
+                  engine == Engine::Interpreter ? "interpreter"
+                                                : "recompiler");
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+// A traced corpus run, read back, has to list exactly what a second
+// machine stepped one instruction at a time runs: each pc and opcode, and
+// I, Vx and VF after it
+bool CheckTrace(std::vector<Rom> const &roms) {
+  std::filesystem::path path = std::filesystem::temp_directory_path() /
+                               ("chip8-units-" +
+                                std::to_string(std::random_device()()) +
+                                ".trc");
+  std::unique_ptr<Chip8State> state = std::make_unique<Chip8State>();
+  bool passed = true;
+
+  for (Rom const &rom : roms) {
+    Script const &script = rom.script;
+    Variant variant = script.variants.front();
+    Chip8 traced(script.seed, variant);
+    traced.LoadROM(rom.data.data(), rom.data.size());
+
+    TraceWriter writer;
+    TraceReader reader;
+    std::string error;
+    if (!writer.Open(path.string().c_str(), variant, error)) {
+      std::printf("FAIL trace %s: %s\n", rom.name.c_str(), error.c_str());
+      passed = false;
+      continue;
+    }
+    traced.SetTracer(&writer);
+    InputLog input = script.input;
+    for (uint32_t frame = 0; frame < script.frames; ++frame) {
+      traced.SetKeypad(input.KeysAt(frame));
+      traced.RunFrame(script.speed);
+    }
+    traced.SetTracer(nullptr);
+    if (!writer.Close() || !reader.Open(path.string().c_str(), error) ||
+        reader.GetVariant() != variant) {
+      std::printf("FAIL trace %s: cannot read the trace back %s\n",
+                  rom.name.c_str(), error.c_str());
+      passed = false;
+      continue;
+    }
+
+    Chip8 stepped(script.seed, variant);
+    stepped.LoadROM(rom.data.data(), rom.data.size());
+    stepped.SaveState(*state);
+    input = script.input;
+    TraceRecord record;
+    uint64_t done = 0;
+    bool matched = true;
+    for (uint32_t frame = 0; frame < script.frames && matched; ++frame) {
+      stepped.SetKeypad(input.KeysAt(frame));
+      for (uint32_t i = 0; i < script.speed && matched; ++i, ++done) {
+        uint16_t pc = state->pc;
+        uint16_t address = pc & (CODE_MEMORY - 1u);
+        uint16_t opcode = state->memory[address] << 8u |
+                          state->memory[address + 1];
+        stepped.RunCycles(1);
+        stepped.SaveState(*state);
+        uint8_t x = (opcode >> 8u) & 0xFu;
+        matched = reader.Next(record) && record.pc == pc &&
+                  record.opcode == opcode && record.index == state->index &&
+                  record.vx == state->registers[x] &&
+                  record.vf == state->registers[0xF];
+      }
+      stepped.TickTimers();
+    }
+
+    if (!matched) {
+      std::printf("FAIL trace %s: instruction %" PRIu64 " differs\n",
+                  rom.name.c_str(), done - 1);
+      passed = false;
+    } else if (reader.Next(record) || reader.Failed()) {
+      std::printf("FAIL trace %s: trace does not end after %" PRIu64
+                  " instructions\n",
+                  rom.name.c_str(), done);
+      passed = false;
+    }
+  }
+
+  std::filesystem::remove(path);
+  return passed;
+}
+
+// Faults only once key 5 and then key A have each been held for a step
+uint8_t const lockedRom[] = {
+    0x60, 0x00, // 200: V0 = 0
+    0x61, 0x05, // 202: V1 = 5
+    0x62, 0x0A, // 204: V2 = A
+    0xE1, 0x9E, // 206: skip if key V1 is down
+    0x12, 0x0E, // 208: jump 20E
+    0x60, 0x01, // 20A: V0 = 1
+    0x12, 0x06, // 20C: jump 206
+    0x30, 0x01, // 20E: skip if V0 = 1
+    0x12, 0x06, // 210: jump 206
+    0xE2, 0x9E, // 212: skip if key V2 is down
+    0x12, 0x06, // 214: jump 206
+    0x01, 0x23, // 216: invalid
+};
+
+bool SameNodes(Explorer const &a, Explorer const &b) {
+  if (a.Nodes().size() != b.Nodes().size() ||
+      a.Duplicates() != b.Duplicates() || a.Screens() != b.Screens() ||
+      a.Faults() != b.Faults()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.Nodes().size(); ++i) {
+    Explorer::Node const &x = a.Nodes()[i];
+    Explorer::Node const &y = b.Nodes()[i];
+    if (x.parent != y.parent || x.depth != y.depth || x.key != y.key ||
+        x.hash != y.hash || x.fault != y.fault) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The explorer finds the one input sequence that faults a small ROM,
+// block hashes follow a state from frame to frame, and exploring the
+// corpus gives the same nodes on one thread as on several
+bool CheckExplorer(std::vector<Rom> const &roms) {
+  // Too large for the stack
+  std::unique_ptr<Chip8State[]> states(new Chip8State[2]);
+  Chip8State &root = states[0];
+  Chip8State &next = states[1];
+  bool passed = true;
+
+  {
+    Chip8 chip8(DEFAULT_SEED);
+    chip8.LoadROM(lockedRom, sizeof(lockedRom));
+    chip8.SaveState(root);
+    ThreadPool pool(EXPLORE_THREADS);
+    Explorer explorer(pool, Explorer::Settings{});
+    explorer.Run(root);
+
+    std::vector<uint32_t> const &faults = explorer.Faults();
+    std::vector<uint8_t> const sequence = {0x5, 0xA};
+    if (faults.size() != 1 || explorer.Inputs(faults[0]) != sequence ||
+        explorer.Nodes()[faults[0]].fault != Fault::InvalidOpcode ||
+        explorer.Nodes()[faults[0]].faultAddress != 0x216) {
+      std::printf("FAIL explorer: did not find the one faulting input "
+                  "sequence, 5 then A\n");
+      passed = false;
+    }
+  }
+
+  for (Rom const &rom : roms) {
+    Script const &script = rom.script;
+    Explorer::Settings settings;
+    settings.variant = script.variants.front();
+    settings.instructionsPerFrame = script.speed;
+    settings.maxStates = EXPLORE_STATES;
+
+    Chip8 chip8(script.seed, settings.variant);
+    chip8.LoadROM(rom.data.data(), rom.data.size());
+    chip8.SaveState(root);
+    ThreadPool one(1);
+    ThreadPool several(EXPLORE_THREADS);
+    Explorer serial(one, settings);
+    Explorer parallel(several, settings);
+    serial.Run(root);
+    parallel.Run(root);
+    if (!SameNodes(serial, parallel)) {
+      std::printf("FAIL explorer %s: %u threads found different nodes than "
+                  "one\n",
+                  rom.name.c_str(), EXPLORE_THREADS);
+      passed = false;
+    }
+
+    InputLog input = script.input;
+    for (uint32_t frame = 0; frame < script.frames; ++frame) {
+      chip8.SetKeypad(input.KeysAt(frame));
+      chip8.RunFrame(script.speed);
+      chip8.SaveState(next);
+      if (UpdateBlockHash(BlockHash(root), root, next) != BlockHash(next)) {
+        std::printf("FAIL explorer %s: block hash not updated after frame "
+                    "%u\n",
+                    rom.name.c_str(), frame);
+        passed = false;
+        break;
+      }
+      root = next;
+    }
+  }
+  return passed;
+}
+
+// Two batches seeded alike, given the same ROM and keys, step through the
+// same states, and each instance reports how its step ended
+bool CheckBatch(std::vector<Rom> const &roms) {
+  ThreadPool pool(EXPLORE_THREADS);
+  bool passed = true;
+
+  // Keys 5 and A run the locked ROM into its fault with fault stops on,
+  // while the second instance waits on Fx0A
+  uint8_t const waitRom[] = {0xF0, 0x0A};
+  Batch locked(BATCH_INSTANCES, pool, DEFAULT_SEED);
+  locked.LoadROM(lockedRom, sizeof(lockedRom));
+  locked.Instance(0).SetStopOnFault(true);
+  locked.Instance(1).LoadROM(waitRom, sizeof(waitRom));
+  locked.SetKeys(0, 1u << 0x5);
+  locked.StepFrame(DEFAULT_SPEED);
+  locked.SetKeys(0, 1u << 0xA);
+  locked.StepFrame(DEFAULT_SPEED);
+  if (locked.StopReasons()[0] != StopReason::Fault ||
+      locked.CyclesLeft()[0] == 0 ||
+      locked.Faults()[0] != Fault::InvalidOpcode ||
+      locked.StopReasons()[1] != StopReason::KeyWait ||
+      locked.CyclesLeft()[1] != 0 || locked.Faults()[1] != Fault::None) {
+    std::printf("FAIL batch: stop reasons, cycles left or faults wrong\n");
+    passed = false;
+  }
+
+  for (Rom const &rom : roms) {
+    Script const &script = rom.script;
+    Batch first(BATCH_INSTANCES, pool, script.seed, script.variants.front());
+    Batch second(BATCH_INSTANCES, pool, script.seed, script.variants.front());
+    first.LoadROM(rom.data.data(), rom.data.size());
+    second.LoadROM(rom.data.data(), rom.data.size());
+
+    InputLog input = script.input;
+    for (uint32_t frame = 0; frame < script.frames; ++frame) {
+      uint16_t keys = input.KeysAt(frame);
+      for (size_t i = 0; i < BATCH_INSTANCES; ++i) {
+        first.SetKeys(i, keys);
+        second.SetKeys(i, keys);
+      }
+      first.StepFrame(script.speed);
+      second.StepFrame(script.speed);
+    }
+
+    for (size_t i = 0; i < BATCH_INSTANCES; ++i) {
+      if (first.Instance(i).StateHash() != second.Instance(i).StateHash()) {
+        std::printf("FAIL batch %s: instance %zu does not repeat\n",
+                    rom.name.c_str(), i);
+        passed = false;
+      }
+    }
+  }
+  return passed;
+}
+
+std::string ThroughputKey(Job const &job) {
+  return job.rom->name + " " + VariantName(job.variant) + " " +
+         EngineName(job.engine);
+}
+
+// Rounds rather than back to back runs, so a burst of load elsewhere
+// slows one run of many jobs instead of every run of one
+void MeasureRounds(ThreadPool &pool, std::vector<Job *> const &jobs,
+                   uint64_t cycles) {
+  for (unsigned int round = 0; round < THROUGHPUT_ROUNDS; ++round) {
+    pool.ParallelFor(jobs.size(), [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        MeasureThroughput(*jobs[i], cycles);
+      }
+    });
+  }
+}
+
+// A ROM is judged on the geometric mean over its runs, which single noisy
+// runs move far less than they move themselves. False without a baseline.
+bool RomChange(Rom const &rom, std::vector<Job> const &jobs,
+               std::map<std::string, double> const &baseline,
+               double &change) {
+  double logChange = 0;
+  unsigned int compared = 0;
+
+  for (Job const &job : jobs) {
+    auto found = baseline.find(ThroughputKey(job));
+    if (job.rom == &rom && found != baseline.end() && found->second > 0) {
+      logChange += std::log(job.rate / found->second);
+      ++compared;
+    }
+  }
+
+  change = compared > 0 ? std::exp(logChange / compared) - 1.0 : 0.0;
+  return compared > 0;
+}
+
+// The baseline holds "rom variant engine instructions-per-second" lines. It
+// is written when missing or on --update, since it only means anything on
+// the machine and build that produced it.
+bool CheckThroughput(ThreadPool &pool, std::vector<Rom> const &roms,
+                     std::vector<Job> &jobs, uint64_t cycles,
+                     std::filesystem::path const &baselinePath,
+                     double threshold, bool update) {
+  std::map<std::string, double> baseline;
+  std::ifstream file(baselinePath);
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t split = line.rfind(' ');
+    if (split != std::string::npos) {
+      baseline[line.substr(0, split)] = std::atof(line.c_str() + split + 1);
+    }
+  }
+
+  bool record = update || baseline.empty();
+  if (record) {
+    baseline.clear();
+  }
+
+  // Apparent regressions get another set of rounds before they count
+  std::vector<Job *> suspects;
+  for (Rom const &rom : roms) {
+    double change;
+    if (RomChange(rom, jobs, baseline, change) && change < -threshold) {
+      for (Job &job : jobs) {
+        if (job.rom == &rom) {
+          suspects.push_back(&job);
+        }
+      }
+    }
+  }
+  MeasureRounds(pool, suspects, cycles);
+
+  bool passed = true;
+  for (Rom const &rom : roms) {
+    for (Job const &job : jobs) {
+      if (job.rom != &rom) {
+        continue;
+      }
+      std::string key = ThroughputKey(job);
+      auto found = baseline.find(key);
+      if (found == baseline.end() || found->second <= 0) {
+        std::printf("     %-36s %12.0f instr/s\n", key.c_str(), job.rate);
+      } else {
+        std::printf("     %-36s %12.0f instr/s %+6.1f%%\n", key.c_str(),
+                    job.rate, 100.0 * (job.rate / found->second - 1.0));
+      }
+    }
+
+    double change;
+    if (RomChange(rom, jobs, baseline, change)) {
+      bool regressed = change < -threshold;
+      std::printf("%s %-36s %+6.1f%%\n", regressed ? "FAIL" : "    ",
+                  rom.name.c_str(), 100.0 * change);
+      passed = passed && !regressed;
+    }
+  }
+
+  if (record) {
+    std::FILE *out = std::fopen(baselinePath.string().c_str(), "w");
+    if (!out) {
+      std::printf("FAIL could not write %s\n", baselinePath.string().c_str());
+      return false;
+    }
+    for (Job const &job : jobs) {
+      std::fprintf(out, "%s %.0f\n", ThroughputKey(job).c_str(), job.rate);
+    }
+    std::fclose(out);
+    std::printf("Recorded the throughput baseline in %s\n",
+                baselinePath.string().c_str());
+  }
+  return passed;
+}
+
+void Usage(char const *program) {
+  std::cerr << "Usage: " << program
+            << " <Directory> [--update] [--throughput BASELINE]"
+               " [--threshold FRACTION] [--cycles N] [--lockstep N]"
+               " [--stops] [--checked] [--units]\n";
+  std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+// Runs every ROM in a directory headless, once per variant its script
+// names and once per engine, all in parallel. Without --throughput the
+// state and framebuffer hashes at each checkpoint are compared against the
+// ROM's golden file; with it every run's instructions per second are
+// compared against a baseline instead. With --lockstep every run is
+// instead compared against the reference as it goes, checking every N
+// instructions, and the first instruction where they part is reported.
+// --stops runs against the goldens with draw and fault stops on, and
+// --checked with breakpoints and watchpoints that stop at every draw and
+// store. --units checks the parts around the core instead, such as the
+// rewind buffer, on the corpus ROMs.
+int main(int argc, char **argv) {
+  char const *directory = nullptr;
+  char const *baseline = nullptr;
+  double threshold = DEFAULT_THRESHOLD;
+  uint64_t cycles = DEFAULT_CYCLES;
+  uint32_t interval = 0;
+  bool update = false;
+  bool stops = false;
+  bool checked = false;
+  bool units = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--update") == 0) {
+      update = true;
+    } else if (std::strcmp(argv[i], "--throughput") == 0 && i + 1 < argc) {
+      baseline = argv[++i];
+    } else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+      cycles = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc) {
+      interval = std::strtoul(argv[++i], nullptr, 10);
+      if (interval == 0) {
+        Usage(argv[0]);
+      }
+    } else if (std::strcmp(argv[i], "--stops") == 0) {
+      stops = true;
+    } else if (std::strcmp(argv[i], "--checked") == 0) {
+      checked = true;
+    } else if (std::strcmp(argv[i], "--units") == 0) {
+      units = true;
+    } else if (argv[i][0] == '-' || directory) {
+      Usage(argv[0]);
+    } else {
+      directory = argv[i];
+    }
+  }
+
+  if (!directory || cycles == 0 || cycles > UINT32_MAX ||
+      ((stops || checked || units) && update)) {
+    Usage(argv[0]);
+  }
+
+  std::vector<Rom> roms;
+  if (!LoadCorpus(directory, roms)) {
+    return EXIT_FAILURE;
+  }
+  if (roms.empty()) {
+    std::cerr << "No ROMs in " << directory << "\n";
+    return EXIT_FAILURE;
+  }
+
+  if (units) {
+    bool passed = CheckRewind(roms);
+    passed = CheckRomDatabase(roms) && passed;
+    passed = CheckDetectVariant() && passed;
+    passed = CheckLoadRom() && passed;
+    passed = CheckKeypad() && passed;
+    passed = CheckTrace(roms) && passed;
+    passed = CheckExplorer(roms) && passed;
+    passed = CheckBatch(roms) && passed;
+    std::printf("%zu ROMs, unit checks: %s\n", roms.size(),
+                passed ? "passed" : "FAILED");
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  // Throughput is only tracked for the dispatch the build defaults to
+  Dispatch const defaultDispatch = Chip8(DEFAULT_SEED).GetDispatch();
+
+  std::vector<Job> jobs;
+  for (Rom &rom : roms) {
+    for (Variant variant : rom.script.variants) {
+      for (Engine engine : engines) {
+        for (Dispatch dispatch : dispatches) {
+          bool measured = baseline || engine == Engine::Recompiler;
+          bool reference = engine == Engine::Interpreter &&
+                           dispatch == Dispatch::Cached;
+          if ((measured && dispatch != defaultDispatch) ||
+              (interval && reference)) {
+            continue;
+          }
+          Job job;
+          job.rom = &rom;
+          job.variant = variant;
+          job.engine = engine;
+          job.dispatch = dispatch;
+          jobs.push_back(std::move(job));
+        }
+      }
+    }
+  }
+
+  ThreadPool pool;
+  auto start = std::chrono::steady_clock::now();
+  if (baseline) {
+    std::vector<Job *> all;
+    for (Job &job : jobs) {
+      all.push_back(&job);
+    }
+    MeasureRounds(pool, all, cycles);
+  } else if (interval) {
+    pool.ParallelFor(jobs.size(), [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        RunLockstep(jobs[i], interval);
+      }
+    });
+  } else {
+    pool.ParallelFor(jobs.size(), [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        RunScript(jobs[i], stops, checked);
+      }
+    });
+  }
+
+  bool passed = false;
+  if (baseline) {
+    passed = CheckThroughput(pool, roms, jobs, cycles, baseline, threshold,
+                             update);
+  } else if (interval) {
+    passed = CheckLockstep(jobs);
+  } else {
+    passed = CheckConformance(roms, jobs, update);
+    passed = (!(stops || checked) || CheckStops(jobs)) && passed;
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  std::printf("%zu ROMs, %zu runs on %u threads in %.2f s: %s\n",
+              roms.size(), jobs.size(), pool.Size(),
+              std::chrono::duration<double>(end - start).count(),
+              passed ? "passed" : "FAILED");
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}